@@ -1,4 +1,4 @@
-// Str v0.33
+// Str v0.58
 // Simple C++ string type with an optional local buffer, by Omar Cornut
 // https://github.com/ocornut/str
 
@@ -16,11 +16,12 @@
 /*
 - This isn't a fully featured string class.
 - It is a simple, bearable replacement to std::string that isn't heap abusive nor bloated (can actually be debugged by humans).
-- String are mutable. We don't maintain size so length() is not-constant time.
-- Maximum string size currently limited to 2 MB (we allocate 21 bits to hold capacity).
-- Local buffer size is currently limited to 1023 bytes (we allocate 10 bits to hold local buffer size).
+- String are mutable. We don't maintain size so length() is not-constant time (unless STR_TRACK_LENGTH is enabled, see below).
+- Maximum string size currently limited to 2 MB (we allocate 21 bits to hold capacity). 2 GB with STR_WIDE_HEADER.
+- Local buffer size is currently limited to 1023 bytes (we allocate 10 bits to hold local buffer size). 65535 bytes with STR_WIDE_HEADER.
 - In "non-owned" mode for literals/reference we don't do any tracking/counting of references.
-- Overhead is 8-bytes in 32-bits, 16-bytes in 64-bits (12 + alignment).
+- Calling make_shared() opts a string into reference-counted mode: copies share the buffer, mutations make a private copy first.
+- Overhead is 8-bytes in 32-bits, 16-bytes in 64-bits (12 + alignment). STR_WIDE_HEADER uses those 4 bytes of padding (12-bytes in 32-bits).
 - This code hasn't been tested very much. it is probably incomplete or broken. Made it for my own use.
 
 The idea is that you can provide an arbitrary sized local buffer if you expect string to fit
@@ -46,9 +47,11 @@ Functions:
    Str256 s;
    s.set("hello sailor");                   // set (copy)
    s.setf("%s/%s.tmp", folder, filename);   // set (w/format)
-   s.append("hello");                       // append. cost a length() calculation!
-   s.appendf("hello %d", 42);               // append (w/format). cost a length() calculation!
+   s.append("hello");                       // append. cost a length() calculation! (unless STR_TRACK_LENGTH is enabled)
+   s.appendf("hello %d", 42);               // append (w/format). cost a length() calculation! (unless STR_TRACK_LENGTH is enabled)
    s.set_ref("Hey!");                       // set (literal/reference, just copy pointer, no tracking)
+   s.fmt_set("{}/{}.tmp", folder, 42);      // set (type-safe format, reserve once, checked at compile-time with C++20)
+   s.fmt_append(" {:.2} {:x}", 1.5f, 255);  // append (type-safe format): "{}", "{:x}" hex, "{:.N}" float decimals, "{{" and "}}" for braces
 
 Constructor helper for format string: add a trailing 'f' to the type. Underlying type is the same.
 
@@ -70,6 +73,46 @@ All StrXXX types derives from Str and instance hold the local buffer capacity. S
 
 /*
  CHANGELOG
+  0.58 - STR_USE_POOL_ALLOCATOR can be combined with custom STR_MEMALLOC/STR_MEMFREE/STR_MEMREALLOC hooks forwarding to StrPoolAlloc()/StrPoolFree()/StrPoolRealloc(), e.g. to count allocations.
+         breaking change: StrHashMap<V> requires #define STR_ENABLE_HASH_MAP 1, std::hash<Str> is only defined with STR_SUPPORT_STD_STRING. Str.h no longer includes <functional>, nor <new> outside of the implementation.
+         breaking change: StrInterner, map_file() and StrLineReader, StrTable, StrLogBuffer require #define STR_ENABLE_INTERNER, STR_ENABLE_FILES, STR_ENABLE_TABLE, STR_ENABLE_LOG_BUFFER.
+         fixed GCC -Wfree-nonheap-object false positives with STR_WIDE_HEADER (-O3).
+         rfind(char) and rfind(const char*) scan backward 16 bytes at a time with SSE2, rfind(const char*) with the same first and last byte filter as find().
+         clear() on a string already using its local buffer only resets the length, fixing GCC -Warray-bounds false positives (-O3).
+         fixed Str::GetStats() and Str::DumpStats() dropping the counters of local buffer sizes past the first 64 seen by a thread, now reported as STR_STATS_LOCAL_BUF_SIZE_OTHER.
+         fixed fmt_set()/fmt_append() with string arguments pointing into the destination, which could be overwritten or freed while formatting.
+         fixed "{:x}" of a negative int printing 64 bits instead of 32 like "%x".
+         fixed map_file() accepting files larger than STR_CAPACITY_MAX (2 MB without STR_WIDE_HEADER), which were cut when detaching on write. It now returns false.
+         fixed set(), setf(), append() and appendf() reading freed memory when their source pointed into the string's own shared buffer and it was the last reference. append() also copies a source pointing into its own heap buffer before reallocating.
+         fixed shared_release() reading the mapping of a shared buffer after destroying its header.
+         fixed StrInterned::operator== hiding Str::operator==/operator!= when comparing a handle with a const char*, Str or std::string.
+  0.57 - added append_json_escaped(), append_url_encoded(), append_hex(data, size), append_base64() and decoders append_json_unescaped(), append_url_decoded(), append_hex_decoded(), append_base64_decoded(), with _from() variants. output is measured first and reserved once, SSE2 code paths scan for characters to escape.
+  0.56 - added compare(), relational operators (!=, <, <=, >, >=), common_prefix_length(), StrCompare(), StrCommonPrefixLength() with SSE2 code path. added StrSort() MSD radix sort with cached 8-byte key prefixes for arrays of Str, StrRef and StrView.
+  0.55 - added StrLogBuffer lock-free multi-producer log buffer: records reserve space with one atomic add and are formatted in place, one consumer drains them in order to a file descriptor or a Str.
+  0.54 - added StrTable packed table of strings stored in a single character arena, with append_lines(), compact(), save() and load() mapping a saved table back without parsing.
+  0.53 - added STR_MEMREALLOC hook (realloc() by default): growing and shrinking a heap buffer can happen in place. copies when leaving a local buffer or a non-owned string are bounded by the string length instead of zero-filling the new capacity with strncpy(). added StrPoolRealloc().
+  0.52 - added to_lower(), to_upper(), equals_ignore_case(), is_valid_utf8(), utf8_length() with SSE2 code paths, and StrToLower(), StrToUpper(), StrEqualsIgnoreCase(), StrIsValidUtf8(), StrUtf8Length() for ranges.
+  0.51 - added StrScratch per-thread ring of reusable buffers for temporary strings, returning StrScratchRef checked against reuse with STR_SCRATCH_CHECK.
+  0.50 - added concat(), concat_from(), join(), join_from() measuring all pieces first, reserving once and copying each piece once. added StrView(const std::string&).
+  0.49 - added map_file() mapping a file read-only as a shared buffer, unmapped when the last copy is released. added StrLineReader streaming lines from a file descriptor into a reused buffer.
+  0.48 - added optional STR_USE_INLINE_BUFFER mode storing short strings inside the header of a Str without local buffer (7 characters on 64-bits).
+         fixed self-assignment of a non-owned string clearing it.
+  0.47 - added StrHash() 64-bit hash, Str::hash(), std::hash<Str> and StrHashMap<V> open-addressing map with inline short keys. StrInterner uses StrHash(), StrInterned::hash() is now 64-bit.
+  0.46 - added fmt_set(), fmt_append(), fmt_append_from() type-safe formatting with "{}" placeholders, checked at compile time with C++20. added StrXXXf::fmt() helpers.
+  0.45 - added optional STR_ENABLE_STATS mode collecting construction, heap spill, reallocation and length statistics per local buffer size. added Str::GetStats(), Str::DumpStats().
+  0.44 - added StrBuilder: chunked builder for large outputs, flattened once into a Str or written directly to a FILE* or file descriptor.
+  0.43 - added StrView (non-owned character range) and StrSplit zero-allocation tokenizer. added set(StrView), append(StrView), append_from(int, StrView).
+  0.42 - added find(), rfind(), find_first_of(), contains(), starts_with(), ends_with(), count() with SSE2 code paths (STR_USE_SSE2).
+  0.41 - added make_shared() opt-in reference-counted shared buffers: copies only bump a counter, mutations detach (copy-on-write).
+         fixed writing into the read-only empty buffer when setting or appending an empty string to a non-owned string (e.g. Str s = "").
+  0.40 - added StrInterner and StrInterned: thread-safe string interning returning non-owned handles with O(1) equality.
+  0.39 - added optional STR_USE_POOL_ALLOCATOR built-in allocator with thread-local size-class free lists, and StrPoolGetStats().
+  0.38 - added append_int(), append_uint(), append_hex(), append_float() and their _from() variants, formatting numbers without going through vsnprintf.
+  0.37 - added move constructor and move assignment operator, stealing heap buffers instead of copying.
+  0.36 - added optional STR_WIDE_HEADER layout lifting limits to 2 GB capacity and 64 KB local buffers, at no extra cost on 64-bits architecture.
+  0.35 - reserve() now grows capacity geometrically (STR_GROW_CAPACITY, 1.5x by default) so repeated append() calls are amortized. added reserve_exact().
+         fixed Capacity/LocalBufSize bitfields being signed, which halved the documented limits and broke clear() on Str512.
+  0.34 - added optional STR_TRACK_LENGTH mode storing the length in the header, making length() O(1) and append() O(k). added update_length().
   0.33 - fixed capacity() return value to match standard. e.g. a Str256's capacity() now returns 255, not 256.
   0.32 - added owned() accessor.
   0.31 - fixed various warnings.
@@ -87,7 +130,6 @@ All StrXXX types derives from Str and instance hold the local buffer capacity. S
 
 /*
 TODO
-- Since we lose 4-bytes of padding on 64-bits architecture, perhaps just spread the header to 8-bytes and lift size limits?
 - More functions/helpers.
 */
 
@@ -98,6 +140,37 @@ TODO
 // CONFIGURATION
 //-------------------------------------------------------------------------
 
+// Configuration: #define STR_USE_POOL_ALLOCATOR 1 to route STR_MEMALLOC/STR_MEMFREE to a built-in allocator (off by default)
+// - Thread-local free lists for power-of-two size classes from 32 bytes to 4 KB, larger blocks go straight to malloc().
+// - Blocks may be freed from any thread: they go to the free list of the thread freeing them.
+// - Each free list holds up to STR_POOL_CACHE_BYTES, extra blocks are returned to free().
+// - Call StrPoolGetStats() to retrieve hit rate.
+// - To wrap the pool (e.g. to count allocations), define all of STR_MEMALLOC/STR_MEMFREE/STR_MEMREALLOC yourself and forward them to StrPoolAlloc()/StrPoolFree()/StrPoolRealloc().
+#ifndef STR_USE_POOL_ALLOCATOR
+#define STR_USE_POOL_ALLOCATOR 0
+#endif
+#if STR_USE_POOL_ALLOCATOR
+#if defined(STR_MEMALLOC) || defined(STR_MEMFREE) || defined(STR_MEMREALLOC)
+#if !defined(STR_MEMALLOC) || !defined(STR_MEMFREE) || !defined(STR_MEMREALLOC)
+#error "STR_USE_POOL_ALLOCATOR with custom hooks needs all of STR_MEMALLOC/STR_MEMFREE/STR_MEMREALLOC, forwarding to StrPoolAlloc/StrPoolFree/StrPoolRealloc"
+#endif
+#else
+#define STR_MEMALLOC  StrPoolAlloc
+#define STR_MEMFREE   StrPoolFree
+#define STR_MEMREALLOC StrPoolRealloc
+#endif
+#ifndef STR_POOL_CACHE_BYTES
+#define STR_POOL_CACHE_BYTES    (64 * 1024)
+#endif
+#include <stdlib.h>   // for malloc, free
+#endif
+
+// Configuration: STR_MEMREALLOC(ptr, size) is used to grow or shrink heap buffers, which may happen in place.
+// Defaults to realloc(), unless you provide your own STR_MEMALLOC/STR_MEMFREE without STR_MEMREALLOC: then we allocate a new buffer and copy the string.
+#if !defined(STR_MEMREALLOC) && !defined(STR_MEMALLOC) && !defined(STR_MEMFREE)
+#define STR_MEMREALLOC realloc
+#endif
+
 #ifndef STR_MEMALLOC
 #define STR_MEMALLOC  malloc
 #include <stdlib.h>
@@ -114,6 +187,7 @@ TODO
 #define STR_API
 #endif
 #include <stdarg.h>   // for va_list
+#include <stdio.h>    // for FILE
 #include <string.h>   // for strlen, strcmp, memcpy, etc.
 
 // Configuration: #define STR_SUPPORT_STD_STRING 0 to disable setters variants using const std::string& (on by default)
@@ -126,30 +200,342 @@ TODO
 #define STR_DEFINE_STR32 0
 #endif
 
+// Configuration: #define STR_WIDE_HEADER 1 to use a wider header layout (off by default)
+// - Capacity is 31 bits (max 2 GB) and LocalBufSize is 16 bits (max 65535 bytes), so you can STR_DEFINETYPE(Str4096, 4096).
+// - Uses the 4 bytes of padding of the default layout: sizeof(Str) stays 16 on 64-bits architecture, grows from 8 to 12 on 32-bits architecture.
+#ifndef STR_WIDE_HEADER
+#define STR_WIDE_HEADER 0
+#endif
+
+// Configuration: growth policy used by reserve() and all append functions when they need to reallocate.
+// Default is 1.5x. Result is clamped to STR_CAPACITY_MAX. Use reserve_exact() if you need tight sizing.
+#ifndef STR_GROW_CAPACITY
+#define STR_GROW_CAPACITY(cur_capacity)     ((cur_capacity) + (cur_capacity) / 2)
+#endif
+
+// Configuration: #define STR_USE_SSE2 0 to disable SSE2 code paths in search functions (on by default when compiling for x86-64 or with SSE2 enabled)
+#ifndef STR_USE_SSE2
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STR_USE_SSE2 1
+#else
+#define STR_USE_SSE2 0
+#endif
+#endif
+
+// Configuration: #define STR_ENABLE_STATS 1 to collect statistics per local buffer size (off by default)
+// - Counts constructions, heap spills, heap bytes, reallocations, format retries and a histogram of lengths at destruction.
+// - Counters are per-thread and merged on read. Call Str::DumpStats() to help choosing local buffer sizes.
+#ifndef STR_ENABLE_STATS
+#define STR_ENABLE_STATS 0
+#endif
+
+// Configuration: #define STR_ENABLE_HASH_MAP 1 to define StrHashMap<V>, see HASHING section below (off by default, includes <new>)
+#ifndef STR_ENABLE_HASH_MAP
+#define STR_ENABLE_HASH_MAP 0
+#endif
+
+// Configuration: optional subsystems, off by default so a plain #include "Str.h" stays light. Define the same ones in your STR_IMPLEMENTATION file.
+// - STR_ENABLE_INTERNER: StrInterner and StrInterned (implementation uses <mutex>)
+// - STR_ENABLE_FILES: Str::map_file() and StrLineReader (implementation uses mmap, open, read)
+// - STR_ENABLE_TABLE: StrTable, also enables STR_ENABLE_FILES for save() and load()
+// - STR_ENABLE_LOG_BUFFER: StrLogBuffer (implementation uses <atomic>, <thread>)
+#ifndef STR_ENABLE_INTERNER
+#define STR_ENABLE_INTERNER 0
+#endif
+#ifndef STR_ENABLE_FILES
+#define STR_ENABLE_FILES 0
+#endif
+#ifndef STR_ENABLE_TABLE
+#define STR_ENABLE_TABLE 0
+#endif
+#if STR_ENABLE_TABLE && !STR_ENABLE_FILES
+#undef STR_ENABLE_FILES
+#define STR_ENABLE_FILES 1
+#endif
+#ifndef STR_ENABLE_LOG_BUFFER
+#define STR_ENABLE_LOG_BUFFER 0
+#endif
+
+// Configuration: #define STR_USE_INLINE_BUFFER 1 to store short strings inside the header of a Str without local buffer (off by default)
+// - Characters are stored right after the Data pointer, overwriting the Capacity/LocalBufSize/Owned fields which are then implied.
+// - Capacity is sizeof(Str) - sizeof(char*) - 1: 7 characters on 64-bits (15 with STR_WIDE_HEADER + STR_TRACK_LENGTH), 3 on 32-bits.
+// - c_str() is unchanged. With STR_TRACK_LENGTH, length() of an inline string is a strlen() of at most that many characters.
+// - StrXXX types with a local buffer are not affected.
+#ifndef STR_USE_INLINE_BUFFER
+#define STR_USE_INLINE_BUFFER 0
+#endif
+
+// Configuration: StrScratch ring, see SCRATCH section below.
+// - STR_SCRATCH_RING_SIZE: number of per-thread buffers, a StrScratchRef is valid until that many other scratch strings are made on the same thread.
+// - STR_SCRATCH_KEEP_CAPACITY: buffers that grew larger than this are freed when reused, so one huge temporary doesn't stay allocated.
+// - STR_SCRATCH_CHECK: assert when a StrScratchRef is used after its buffer was reused (on by default unless NDEBUG is defined).
+#ifndef STR_SCRATCH_RING_SIZE
+#define STR_SCRATCH_RING_SIZE       8
+#endif
+#ifndef STR_SCRATCH_KEEP_CAPACITY
+#define STR_SCRATCH_KEEP_CAPACITY   (16 * 1024)
+#endif
+#ifndef STR_SCRATCH_CHECK
+#ifdef NDEBUG
+#define STR_SCRATCH_CHECK 0
+#else
+#define STR_SCRATCH_CHECK 1
+#endif
+#endif
+
+// Configuration: #define STR_TRACK_LENGTH 1 to store the string length in the header (off by default)
+// - length() becomes O(1), append()/appendf() no longer need to scan the whole string.
+// - Fits in the padding on 64-bits architecture, sizeof(Str) grows by 4 bytes on 32-bits architecture (or on both when combined with STR_WIDE_HEADER).
+// - If you write into c_str() or operator[] directly, you MUST call update_length() afterwards.
+#ifndef STR_TRACK_LENGTH
+#define STR_TRACK_LENGTH 0
+#endif
+
 #if STR_SUPPORT_STD_STRING
-#include <string>
+#include <string>     // also declares std::hash, specialized for Str below
+#endif
+#if STR_ENABLE_HASH_MAP
+#include <new>        // for placement new
 #endif
 
 //-------------------------------------------------------------------------
 // HEADERS
 //-------------------------------------------------------------------------
 
+#if STR_WIDE_HEADER
+#define STR_CAPACITY_MAX        (0x7FFFFFFF - 1)    // Limited by Capacity field, +1 for zero terminator must fit in an int
+#define STR_LOCALBUFSIZE_MAX    ((1 << 16) - 1)     // Limited by LocalBufSize bitfield
+#else
+#define STR_CAPACITY_MAX        ((1 << 21) - 1)     // Limited by Capacity bitfield
+#define STR_LOCALBUFSIZE_MAX    ((1 << 10) - 1)     // Limited by LocalBufSize bitfield
+#endif
+
+#if STR_USE_POOL_ALLOCATOR
+// Built-in allocator used when STR_USE_POOL_ALLOCATOR is enabled
+struct StrPoolStats
+{
+    unsigned long long  Hits;                   // Allocations served from a thread-local free list
+    unsigned long long  Misses;                 // Allocations of a pooled size class which had to call malloc()
+    unsigned long long  LargeAllocs;            // Allocations above the largest size class
+    unsigned long long  Frees;                  // Blocks returned to a thread-local free list
+    unsigned long long  Releases;               // Blocks returned to free() (large blocks, or free list was full)
+    float               GetHitRate() const      { return (Hits + Misses) ? (float)Hits / (float)(Hits + Misses) : 0.0f; }
+};
+STR_API void*   StrPoolAlloc(size_t size);
+STR_API void    StrPoolFree(void* ptr);
+STR_API void*   StrPoolRealloc(void* ptr, size_t size);         // Keep the block if 'size' still fits its size class, large blocks use realloc()
+STR_API void    StrPoolGetStats(StrPoolStats* out_stats);  // Totals for all threads. Other running threads publish their counters every few hundred calls.
+#endif
+
+#if STR_ENABLE_STATS
+enum StrStatsCounter
+{
+    StrStatsCounter_Constructions,
+    StrStatsCounter_Spills,                     // Local buffer (or empty/non-owned) -> Heap
+    StrStatsCounter_Reallocs,                   // Heap -> Heap
+    StrStatsCounter_HeapBytes,                  // Total bytes allocated for spills and reallocations
+    StrStatsCounter_FormatRetries,              // setf()/appendf() calls which had to grow and call vsnprintf() a second time
+    StrStatsCounter_COUNT
+};
+#define STR_STATS_HISTOGRAM_BUCKETS     32      // Bucket 0 for empty strings, bucket N for lengths in [2^(N-1), 2^N)
+#define STR_STATS_LOCAL_BUF_SIZE_OTHER  -2      // LocalBufSize of the entry merging local buffer sizes which didn't fit in the per-thread table
+struct StrStatsEntry
+{
+    int                 LocalBufSize;
+    unsigned long long  Counters[StrStatsCounter_COUNT];
+    unsigned long long  LengthHistogram[STR_STATS_HISTOGRAM_BUCKETS];
+};
+STR_API void    StrStatsAdd(int local_buf_size, StrStatsCounter counter, unsigned long long value);
+STR_API void    StrStatsAddLength(int local_buf_size, int length);
+#define STR_STATS(_EXPR)    _EXPR
+#else
+#define STR_STATS(_EXPR)
+#endif
+
+// 64-bit hash of a range of characters (based on wyhash). Stable within a build, but not across architectures of different endianness.
+STR_API unsigned long long StrHash(const char* s, const char* s_end = NULL, unsigned long long seed = 0);
+
+// ASCII case conversion and UTF-8 helpers over a range of characters (SSE2 code paths with STR_USE_SSE2)
+// - StrToLower()/StrToUpper() convert in place, bytes outside of 'A'-'Z'/'a'-'z' are left untouched.
+// - StrIsValidUtf8() rejects overlong encodings, surrogates and codepoints above U+10FFFF.
+// - StrUtf8Length() counts codepoints of valid UTF-8 (every byte which isn't a continuation byte).
+STR_API void    StrToLower(char* s, char* s_end);
+STR_API void    StrToUpper(char* s, char* s_end);
+STR_API bool    StrEqualsIgnoreCase(const char* a, const char* b, int len);
+STR_API bool    StrIsValidUtf8(const char* s, const char* s_end);
+STR_API int     StrUtf8Length(const char* s, const char* s_end);
+
+// Comparison over ranges of characters, in unsigned byte order (same as strcmp() and memcmp()).
+// - StrCommonPrefixLength() returns the index of the first difference within 'len' bytes, or 'len' (SSE2 code path with STR_USE_SSE2).
+// - StrCompare() returns <0, 0 or >0. A range sorts before any longer range it is a prefix of.
+STR_API int     StrCommonPrefixLength(const char* a, const char* b, int len);
+STR_API int     StrCompare(const char* a, const char* a_end, const char* b, const char* b_end);
+
+// Non-owned view over a range of characters, not necessarily zero-terminated. Used by StrSplit and as a parameter type.
+class Str;
+struct StrView
+{
+    const char*         Begin;
+    const char*         End;
+
+    StrView() : Begin(NULL), End(NULL) {}
+    StrView(const char* b, const char* e) : Begin(b), End(e) {}
+    StrView(const char* s) : Begin(s), End(s + strlen(s)) {}
+    inline StrView(const Str& s);
+#if STR_SUPPORT_STD_STRING
+    StrView(const std::string& s) : Begin(s.c_str()), End(s.c_str() + s.length()) {}
+#endif
+    inline int          length() const                          { return (int)(End - Begin); }
+    inline bool         empty() const                           { return Begin == End; }
+    inline char         operator[](size_t i) const              { return Begin[i]; }
+    inline bool         operator==(const StrView& rhs) const    { return length() == rhs.length() && memcmp(Begin, rhs.Begin, (size_t)length()) == 0; }
+    inline bool         operator!=(const StrView& rhs) const    { return !(*this == rhs); }
+    inline int          compare(const StrView& rhs) const       { return StrCompare(Begin, End, rhs.Begin, rhs.End); }
+    inline bool         operator<(const StrView& rhs) const     { return compare(rhs) < 0; }
+};
+
+// Type-safe formatting helpers for fmt_set()/fmt_append(), see below.
+// Arguments are converted to a StrFmtArg without copying string contents. Supported types:
+// - integers, bool ("true"/"false"), char, float/double, pointers (as "0x" + hexadecimal)
+// - const char* (NULL prints "(null)"), Str and derived types, StrView, std::string (with STR_SUPPORT_STD_STRING)
+struct StrFmtArg
+{
+    enum ArgType { ArgType_None, ArgType_Int, ArgType_Int32, ArgType_Uint, ArgType_Float, ArgType_Char, ArgType_String, ArgType_Pointer }; // ArgType_Int32: int and narrower, for "{:x}" of negative values
+    ArgType             Type;
+    union
+    {
+        long long           Int;
+        unsigned long long  Uint;
+        double              Float;
+        char                Char;
+        const void*         Pointer;
+    };
+    const char*         StrBegin;               // Only for ArgType_String
+    const char*         StrEnd;
+
+    StrFmtArg() : Type(ArgType_None), Int(0), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(bool v) : Type(ArgType_String), Int(0), StrBegin(v ? "true" : "false"), StrEnd(StrBegin + (v ? 4 : 5)) {}
+    StrFmtArg(char v) : Type(ArgType_Char), Int(0), StrBegin(NULL), StrEnd(NULL) { Char = v; }
+    StrFmtArg(signed char v) : Type(ArgType_Int32), Int(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(unsigned char v) : Type(ArgType_Uint), Uint(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(short v) : Type(ArgType_Int32), Int(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(unsigned short v) : Type(ArgType_Uint), Uint(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(int v) : Type(ArgType_Int32), Int(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(unsigned int v) : Type(ArgType_Uint), Uint(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(long v) : Type(sizeof(long) == 4 ? ArgType_Int32 : ArgType_Int), Int(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(unsigned long v) : Type(ArgType_Uint), Uint(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(long long v) : Type(ArgType_Int), Int(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(unsigned long long v) : Type(ArgType_Uint), Uint(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(float v) : Type(ArgType_Float), Float(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(double v) : Type(ArgType_Float), Float(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(const void* v) : Type(ArgType_Pointer), Pointer(v), StrBegin(NULL), StrEnd(NULL) {}
+    StrFmtArg(const char* s) : Type(ArgType_String), Int(0), StrBegin(s ? s : "(null)"), StrEnd(StrBegin + strlen(StrBegin)) {}
+    StrFmtArg(const StrView& s) : Type(ArgType_String), Int(0), StrBegin(s.Begin), StrEnd(s.End) {}
+    inline StrFmtArg(const Str& s);
+#if STR_SUPPORT_STD_STRING
+    StrFmtArg(const std::string& s) : Type(ArgType_String), Int(0), StrBegin(s.c_str()), StrEnd(s.c_str() + s.length()) {}
+#endif
+};
+
+// Format string for a given list of argument types. With C++20 this is checked at compile time:
+// a mismatch between placeholders and arguments fails to compile, with an error mentioning StrFmtError_XXX.
+// Wrap non-literal format strings in StrFmtRuntime() to skip the compile-time check.
+struct StrFmtRuntime
+{
+    const char*         Fmt;
+    explicit StrFmtRuntime(const char* fmt) : Fmt(fmt) {}
+};
+
+#if defined(__cpp_consteval) && __cpp_consteval >= 201811L
+#define STR_FMT_CONSTEVAL   1
+void                    StrFmtError_InvalidFormatString();        // Not constexpr: reaching them in a consteval context is a compile error
+void                    StrFmtError_ArgumentCountMismatch();
+
+// Return number of placeholders, or -1 if the format string is malformed
+constexpr int           StrFmtCountPlaceholders(const char* p)
+{
+    int count = 0;
+    while (*p)
+    {
+        if ((p[0] == '{' && p[1] == '{') || (p[0] == '}' && p[1] == '}'))
+            p += 2;
+        else if (p[0] == '}')
+            return -1;
+        else if (p[0] != '{')
+            p++;
+        else
+        {
+            p++;
+            if (p[0] == ':' && p[1] == 'x')
+                p += 2;
+            else if (p[0] == ':' && p[1] == '.' && p[2] >= '0' && p[2] <= '9')
+                for (p += 2; *p >= '0' && *p <= '9'; p++) {}
+            if (*p++ != '}')
+                return -1;
+            count++;
+        }
+    }
+    return count;
+}
+#else
+#define STR_FMT_CONSTEVAL   0
+#endif
+
+template<typename... ARGS>
+struct StrFmtString
+{
+    const char*         Fmt;
+#if STR_FMT_CONSTEVAL
+    template<size_t N>
+    consteval StrFmtString(const char (&fmt)[N]) : Fmt(fmt)
+    {
+        int count = StrFmtCountPlaceholders(fmt);
+        if (count < 0)
+            StrFmtError_InvalidFormatString();
+        if (count != (int)sizeof...(ARGS))
+            StrFmtError_ArgumentCountMismatch();
+    }
+#else
+    StrFmtString(const char* fmt) : Fmt(fmt) {}
+#endif
+    StrFmtString(StrFmtRuntime fmt) : Fmt(fmt.Fmt) {}
+};
+
+// Prevent deduction of ARGS from the format string parameter
+template<typename T> struct StrFmtIdentity { typedef T Type; };
+
 // This is the base class that you can pass around
 // Footprint is 8-bytes (32-bits arch) or 16-bytes (64-bits arch)
 class STR_API Str
 {
     char*               Data;                   // Point to LocalBuf() or heap allocated
-    int                 Capacity : 21;          // Max 2 MB. Exclude zero terminator.
-    int                 LocalBufSize : 10;      // Max 1023 bytes
-    unsigned int        Owned : 1;              // Set when we have ownership of the pointed data (most common, unless using set_ref() method or StrRef constructor)
+#if STR_WIDE_HEADER
+    unsigned int        Capacity : 31;          // Max 2 GB. Exclude zero terminator.
+    unsigned int        Owned : 1;              // Set when we have ownership of the pointed data (most common, unless using set_ref() method or StrRef constructor). When not set, a non-zero Capacity means the buffer is shared (see make_shared()).
+    unsigned int        LocalBufSize : 16;      // Max 65535 bytes. Not in the same word as Capacity/Owned, so writing them doesn't make the compiler forget LocalBufSize.
+#else
+    unsigned int        Capacity : 21;          // Max 2 MB. Exclude zero terminator.
+    unsigned int        LocalBufSize : 10;      // Max 1023 bytes
+    unsigned int        Owned : 1;              // Same as above
+#endif
+                                                // With STR_USE_INLINE_BUFFER, when Data points right after itself all fields above are overwritten by characters, use cur_xxx() accessors to read them.
+#if STR_TRACK_LENGTH
+    int                 Length;                 // Cached strlen(Data), only with STR_TRACK_LENGTH
+#endif
 
 public:
     inline char*        c_str()                                 { return Data; }
     inline const char*  c_str() const                           { return Data; }
     inline bool         empty() const                           { return Data[0] == 0; }
+#if STR_TRACK_LENGTH
+    inline int          length() const                          { return is_inline() ? (int)strlen(Data) : Length; } // call update_length() after writing into the buffer yourself
+#else
     inline int          length() const                          { return (int)strlen(Data); }    // by design, allow user to write into the buffer at any time
-    inline int          capacity() const                        { return Capacity; }
-    inline bool         owned() const                           { return Owned ? true : false; }
+#endif
+    inline int          update_length()                         { int len = (int)strlen(Data); set_length(len); return len; } // resync after writing into c_str() directly (only needed with STR_TRACK_LENGTH)
+    inline int          capacity() const                        { return cur_capacity(); }
+    inline bool         owned() const                           { return cur_owned(); }
+    inline bool         shared() const                          { return !cur_owned() && Capacity != 0; }
 
     inline void         set_ref(const char* src);
     int                 setf(const char* fmt, ...);
@@ -162,15 +548,103 @@ public:
     int                 appendfv(const char* fmt, va_list args);
     int                 append_from(int idx, char c);
     int                 append_from(int idx, const char* s, const char* s_end = NULL);		// If you know the string length or want to append from a certain point
+    inline int          append(const StrView& s)                { return append(s.Begin, s.End); }
+    inline int          append_from(int idx, const StrView& s)  { return append_from(idx, s.Begin, s.End); }
     int                 appendf_from(int idx, const char* fmt, ...);
     int                 appendfv_from(int idx, const char* fmt, va_list args);
 
+    // Numbers: output match printf() "%lld", "%llu", "%llx", "%.*f". Integers don't go through vsnprintf(), append_float() only does for .5 ties, values >= 2^53 once scaled, precision > 15, NaN and infinities.
+    int                 append_int(long long v);
+    int                 append_uint(unsigned long long v);
+    int                 append_hex(unsigned long long v);
+    int                 append_float(double v, int precision = 6);
+    int                 append_int_from(int idx, long long v);
+    int                 append_uint_from(int idx, unsigned long long v);
+    int                 append_hex_from(int idx, unsigned long long v);
+    int                 append_float_from(int idx, double v, int precision = 6);
+
+    // Escaping and encoding: output size is computed first and we reserve once, runs of characters which don't need escaping are copied in bulk
+    // (SSE2 code paths with STR_USE_SSE2). Return length of appended text.
+    // - append_json_escaped(): escape '"', '\\' and control characters for the inside of a JSON string (no quotes added), other bytes including UTF-8 are copied.
+    // - append_url_encoded(): percent-encode all bytes but unreserved characters (RFC 3986: A-Z a-z 0-9 - . _ ~), with uppercase hexadecimal.
+    // - append_hex(data, size): two lowercase hexadecimal digits per byte. append_base64(): standard alphabet, with '=' padding.
+    // Decoders return length of appended data, or -1 on malformed input (the string is then cut at the insertion point).
+    // Decoded data may contain zero bytes: use the returned length rather than length().
+    inline int          append_json_escaped(const StrView& src)     { return append_json_escaped_from(length(), src); }
+    inline int          append_url_encoded(const StrView& src)      { return append_url_encoded_from(length(), src); }
+    inline int          append_hex(const void* data, int size)      { return append_hex_from(length(), data, size); }
+    inline int          append_base64(const void* data, int size)   { return append_base64_from(length(), data, size); }
+    inline int          append_json_unescaped(const StrView& src)   { return append_json_unescaped_from(length(), src); }  // Also decodes "\\uXXXX" and surrogate pairs to UTF-8
+    inline int          append_url_decoded(const StrView& src)      { return append_url_decoded_from(length(), src); }     // "%XX" sequences, '+' is left as is
+    inline int          append_hex_decoded(const StrView& src)      { return append_hex_decoded_from(length(), src); }     // Either case
+    inline int          append_base64_decoded(const StrView& src)   { return append_base64_decoded_from(length(), src); }  // Padding is optional
+    int                 append_json_escaped_from(int idx, const StrView& src);
+    int                 append_url_encoded_from(int idx, const StrView& src);
+    int                 append_hex_from(int idx, const void* data, int size);
+    int                 append_base64_from(int idx, const void* data, int size);
+    int                 append_json_unescaped_from(int idx, const StrView& src);
+    int                 append_url_decoded_from(int idx, const StrView& src);
+    int                 append_hex_decoded_from(int idx, const StrView& src);
+    int                 append_base64_decoded_from(int idx, const StrView& src);
+
+    // Type-safe formatting: we reserve once for the whole output and format numbers with append_int()/append_float() etc. (so floats may still go through vsnprintf(), see above).
+    // Arguments may point into the string itself. Return length of written text, like setf()/appendf().
+    // - "{}" default formatting (floats use 6 decimals like "%f"), "{:x}" hexadecimal integer (negative values of int and narrower types print 32 bits like "%x"), "{:.N}" float with N decimals, "{{" and "}}" for literal braces.
+    // - e.g. s.fmt_set("{}/{}.tmp", folder, filename); s.fmt_append(" x={:.2} y={:x}", 1.5f, 255);
+    template<typename... ARGS> int fmt_set(typename StrFmtIdentity<StrFmtString<ARGS...> >::Type fmt, const ARGS&... args)                 { const StrFmtArg a[] = { StrFmtArg(args)..., StrFmtArg() }; return fmt_appendv_from(0, fmt.Fmt, a, (int)sizeof...(ARGS)); }
+    template<typename... ARGS> int fmt_append(typename StrFmtIdentity<StrFmtString<ARGS...> >::Type fmt, const ARGS&... args)              { const StrFmtArg a[] = { StrFmtArg(args)..., StrFmtArg() }; return fmt_appendv_from(length(), fmt.Fmt, a, (int)sizeof...(ARGS)); }
+    template<typename... ARGS> int fmt_append_from(int idx, typename StrFmtIdentity<StrFmtString<ARGS...> >::Type fmt, const ARGS&... args) { const StrFmtArg a[] = { StrFmtArg(args)..., StrFmtArg() }; return fmt_appendv_from(idx, fmt.Fmt, a, (int)sizeof...(ARGS)); }
+    int                 fmt_appendv_from(int idx, const char* fmt, const StrFmtArg* args, int args_count);
+
+    // Concatenation: pieces may be const char*, Str and derived types, StrView (pointer + end pointer), std::string (with STR_SUPPORT_STD_STRING).
+    // All lengths are measured first, then we reserve once and copy each piece once. Return length of appended text.
+    // - e.g. path.concat(folder, "/", filename, ".tmp"); s.join(", ", names.begin(), names.end());
+    template<typename... ARGS> int concat(const ARGS&... args)                  { const StrView v[] = { StrView(args)..., StrView() }; return joinv_from(length(), StrView(), v, (int)sizeof...(ARGS)); }
+    template<typename... ARGS> int concat_from(int idx, const ARGS&... args)    { const StrView v[] = { StrView(args)..., StrView() }; return joinv_from(idx, StrView(), v, (int)sizeof...(ARGS)); }
+    template<typename IT> int join(const StrView& sep, IT begin, IT end)        { return join_from(length(), sep, begin, end); }
+    template<typename IT> int join_from(int idx, const StrView& sep, IT begin, IT end);
+    int                 joinv_from(int idx, const StrView& sep, const StrView* pieces, int pieces_count);
+
     void                clear();
-    void                reserve(int cap);
+    void                reserve(int cap);                       // Grow following STR_GROW_CAPACITY policy, preserving contents
+    void                reserve_exact(int cap);                 // Grow to exactly 'cap', preserving contents
     void                reserve_discard(int cap);
     void                shrink_to_fit();
+    void                make_shared();                          // Move contents to a reference-counted buffer: copies of this string will share it until they are modified. Call reserve(length()) to detach before writing into c_str() yourself.
+#if STR_ENABLE_FILES
+    bool                map_file(const char* path);             // Map a file read-only as a shared buffer (no copy, up to STR_CAPACITY_MAX bytes: 2 MB, or 2 GB with STR_WIDE_HEADER), unmapped when the last copy is released or modified. Return false on error. Contents are cut at the first zero byte, unless using STR_TRACK_LENGTH.
+#endif
+
+    // Search: return index or -1 if not found. 'from' is a starting index, must be <= length().
+    int                 find(char c, int from = 0) const;
+    int                 find(const char* needle, int from = 0) const;
+    int                 rfind(char c) const;
+    int                 rfind(const char* needle) const;
+    int                 find_first_of(const char* charset, int from = 0) const;
+    int                 count(char c) const;
+    int                 count(const char* needle) const;        // Count non-overlapping occurrences
+    inline bool         contains(char c) const                  { return find(c) != -1; }
+    inline bool         contains(const char* needle) const      { return find(needle) != -1; }
+    bool                starts_with(const char* prefix) const;
+    bool                ends_with(const char* suffix) const;
+    inline unsigned long long hash() const                      { return StrHash(Data, Data + length()); }
+
+    // Ordering in unsigned byte order, same as strcmp(). Return <0, 0 or >0.
+    inline int          compare(const char* rhs) const          { return strcmp(c_str(), rhs); }
+    inline int          compare(const Str& rhs) const           { return strcmp(c_str(), rhs.c_str()); }
+    int                 compare(const StrView& rhs) const;
+    int                 common_prefix_length(const StrView& rhs) const;
+
+    // ASCII case conversion, UTF-8 validation and counting
+    void                to_lower();                             // In place, only 'A'-'Z' are changed. Non-owned strings are copied first.
+    void                to_upper();
+    bool                equals_ignore_case(const StrView& rhs) const; // ASCII case-insensitive comparison
+    inline bool         is_valid_utf8() const                   { return StrIsValidUtf8(Data, Data + length()); }
+    inline int          utf8_length() const                     { return StrUtf8Length(Data, Data + length()); }   // Number of codepoints, for valid UTF-8
 
-    inline char&        operator[](size_t i)                    { return Data[i]; }
+    // Non-const operator[] may be used to write: on a shared buffer (see make_shared()) the first call copies the string, O(length()).
+    // Otherwise it costs a shared() test per call: read through a const Str& or c_str() in hot loops.
+    inline char&        operator[](size_t i)                    { if (shared()) reserve_exact(length()); return Data[i]; }
     inline char         operator[](size_t i) const              { return Data[i]; }
     //explicit operator const char*() const{ return Data; }
 
@@ -178,13 +652,28 @@ public:
     inline Str(const char* rhs);
     inline void         set(const char* src);
     inline void         set(const char* src, const char* src_end);
+    inline void         set(const StrView& src)                 { if (src.Begin) set(src.Begin, src.End); else set(""); }
     inline Str&         operator=(const char* rhs)              { set(rhs); return *this; }
     inline bool         operator==(const char* rhs) const       { return strcmp(c_str(), rhs) == 0; }
+    inline bool         operator!=(const char* rhs) const       { return strcmp(c_str(), rhs) != 0; }
+    inline bool         operator<(const char* rhs) const        { return strcmp(c_str(), rhs) < 0; }
+    inline bool         operator<=(const char* rhs) const       { return strcmp(c_str(), rhs) <= 0; }
+    inline bool         operator>(const char* rhs) const        { return strcmp(c_str(), rhs) > 0; }
+    inline bool         operator>=(const char* rhs) const       { return strcmp(c_str(), rhs) >= 0; }
 
     inline Str(const Str& rhs);
     inline void         set(const Str& src);
     inline Str&         operator=(const Str& rhs)               { set(rhs); return *this; }
     inline bool         operator==(const Str& rhs) const        { return strcmp(c_str(), rhs.c_str()) == 0; }
+    inline bool         operator!=(const Str& rhs) const        { return strcmp(c_str(), rhs.c_str()) != 0; }
+    inline bool         operator<(const Str& rhs) const         { return strcmp(c_str(), rhs.c_str()) < 0; }
+    inline bool         operator<=(const Str& rhs) const        { return strcmp(c_str(), rhs.c_str()) <= 0; }
+    inline bool         operator>(const Str& rhs) const         { return strcmp(c_str(), rhs.c_str()) > 0; }
+    inline bool         operator>=(const Str& rhs) const        { return strcmp(c_str(), rhs.c_str()) >= 0; }
+
+    inline Str(Str&& rhs) noexcept;
+    inline void         set(Str&& src);                         // Steal heap buffer or reference, copy from local buffer
+    inline Str&         operator=(Str&& rhs) noexcept           { set(static_cast<Str&&>(rhs)); return *this; }
 
 #if STR_SUPPORT_STD_STRING
     inline Str(const std::string& rhs);
@@ -196,26 +685,57 @@ public:
     // Destructor for all variants
     inline ~Str()
     {
-        if (Owned && !is_using_local_buf())
-            STR_MEMFREE(Data);
+        STR_STATS(StrStatsAddLength(cur_local_buf_size(), length()));
+        free_data();
     }
 
     static char*        EmptyBuffer;
 
+#if STR_ENABLE_STATS
+    static int          GetStats(StrStatsEntry* out_entries, int max_entries);  // Merge counters from all threads, return number of entries (one per local buffer size)
+    static void         DumpStats(FILE* out = NULL);                            // Print statistics (default to stdout)
+#endif
+
 protected:
+    inline void         free_data()                             { if (is_inline()) LocalBufSize = 0; else if (Owned) { if (!is_using_local_buf()) STR_MEMFREE(Data); } else if (Capacity != 0) shared_release(); } // When leaving the inline buffer, callers write other header fields
+    void                shared_retain();
+    void                shared_release();
+    static void         shared_release(char* data);
+    inline char*        shared_pin()                            { if (!shared()) return NULL; shared_retain(); return Data; } // Keep our shared buffer alive while sources pointing into it are read, release with shared_release(pinned)
+#if STR_TRACK_LENGTH
+    inline void         set_length(int len)                     { if (!is_inline()) Length = len; }
+#else
+    inline void         set_length(int)                         { }
+#endif
     inline char*        local_buf()                             { return (char*)this + sizeof(Str); }
     inline const char*  local_buf() const                       { return (char*)this + sizeof(Str); }
-    inline bool         is_using_local_buf() const              { return Data == local_buf() && LocalBufSize != 0; }
+    inline bool         is_using_local_buf() const              { return is_inline() || (Data == local_buf() && LocalBufSize != 0); } // Inline buffer counts as a local buffer
+    inline bool         points_into(const char* p) const        { return p != NULL && p >= Data && p <= Data + cur_capacity(); } // Source would be invalidated by reserve()
+    inline int          decode_failed(int idx)                  { Data[idx] = 0; set_length(idx); return -1; }
+#if STR_USE_INLINE_BUFFER
+    inline char*        inline_buf()                            { return (char*)this + sizeof(char*); }
+    inline const char*  inline_buf() const                      { return (const char*)this + sizeof(char*); }
+    inline bool         is_inline() const                       { return Data == inline_buf(); }
+    static inline int   inline_capacity()                       { return (int)(sizeof(Str) - sizeof(char*)) - 1; }
+#else
+    inline bool         is_inline() const                       { return false; }
+#endif
+    // Header fields, implied when is_inline()
+    inline int          cur_capacity() const                    { return is_inline() ? (int)(sizeof(Str) - sizeof(char*)) - 1 : (int)Capacity; }
+    inline bool         cur_owned() const                       { return is_inline() || Owned; }
+    inline int          cur_local_buf_size() const              { return is_inline() ? 0 : (int)LocalBufSize; }
 
     // Constructor for StrXXX variants with local buffer
     Str(unsigned short local_buf_size)
     {
-        STR_ASSERT(local_buf_size < 1024);
+        STR_ASSERT(local_buf_size <= STR_LOCALBUFSIZE_MAX);
         Data = local_buf();
         Data[0] = '\0';
         Capacity = local_buf_size ? local_buf_size - 1 : 0;
         LocalBufSize = local_buf_size;
         Owned = 1;
+        set_length(0);
+        STR_STATS(StrStatsAdd(local_buf_size, StrStatsCounter_Constructions, 1));
     }
 };
 
@@ -227,51 +747,98 @@ void    Str::set(const char* src)
         clear();
         return;
     }
-    int buf_len = (int)strlen(src);
-    if (Capacity < buf_len)
-        reserve_discard(buf_len);
-    memcpy(Data, src, (size_t)(buf_len + 1));
-    Owned = 1;
+    set(src, src + strlen(src));
 }
 
 void    Str::set(const char* src, const char* src_end)
 {
     STR_ASSERT(src != NULL && src_end >= src);
     int buf_len = (int)(src_end - src);
-    if ((int)Capacity < buf_len)
+    char* pinned = NULL;
+    if (!cur_owned() || cur_capacity() < buf_len)
+    {
+        pinned = shared_pin(); // Source may point into our shared buffer, which reserve_discard() releases
         reserve_discard(buf_len);
-    memcpy(Data, src, (size_t)buf_len);
+    }
+    memmove(Data, src, (size_t)buf_len); // Source may also be a part of our own buffer
     Data[buf_len] = 0;
-    Owned = 1;
+    set_length(buf_len);
+    if (pinned)
+        shared_release(pinned);
 }
 
 void    Str::set(const Str& src)
 {
-    int buf_len = (int)strlen(src.c_str());
-    if ((int)Capacity < buf_len)
-        reserve_discard(buf_len);
-    memcpy(Data, src.c_str(), (size_t)(buf_len + 1));
-    Owned = 1;
+    if (this == &src)
+        return;
+    if (src.shared())
+    {
+        // Shared -> Share
+        if (Data == src.Data)
+            return;
+        free_data();
+        Data = src.Data;
+        Capacity = src.Capacity;
+        Owned = 0;
+        set_length(src.length());
+        shared_retain();
+        return;
+    }
+    set(src.c_str(), src.c_str() + src.length());
+}
+
+void    Str::set(Str&& src)
+{
+    if (this == &src)
+        return;
+    if (src.cur_owned() ? !src.is_using_local_buf() : src.Capacity != 0)
+    {
+        // Heap or Shared -> Steal buffer, source is left empty
+        free_data();
+        Data = src.Data;
+        Capacity = src.Capacity;
+        Owned = src.Owned;
+        set_length(src.length());
+        src.Owned = 0;
+        src.Capacity = 0;
+        src.clear();
+    }
+    else if (!src.cur_owned())
+    {
+        // Reference -> Copy pointer
+        free_data();
+        Data = src.Data;
+        Capacity = 0;
+        Owned = 0;
+        set_length(src.length());
+    }
+    else
+    {
+        // LocalBuf -> Copy
+        set(static_cast<const Str&>(src));
+    }
 }
 
 #if STR_SUPPORT_STD_STRING
 void    Str::set(const std::string& src)
 {
     int buf_len = (int)src.length();
-    if ((int)Capacity < buf_len)
+    if (!cur_owned() || cur_capacity() < buf_len)
         reserve_discard(buf_len);
     memcpy(Data, src.c_str(), (size_t)(buf_len + 1));
-    Owned = 1;
+    set_length(buf_len);
 }
 #endif
 
 inline void Str::set_ref(const char* src)
 {
-    if (Owned && !is_using_local_buf())
-        STR_MEMFREE(Data);
+    free_data();
     Data = src ? (char*)src : EmptyBuffer;
     Capacity = 0;
     Owned = 0;
+#if STR_TRACK_LENGTH
+    Length = (int)strlen(Data);
+#endif
 }
 
 Str::Str()
@@ -280,6 +847,8 @@ Str::Str()
     Capacity = 0;
     LocalBufSize = 0;
     Owned = 0;
+    set_length(0);
+    STR_STATS(StrStatsAdd(0, StrStatsCounter_Constructions, 1));
 }
 
 Str::Str(const Str& rhs) : Str()
@@ -287,6 +856,11 @@ Str::Str(const Str& rhs) : Str()
     set(rhs);
 }
 
+Str::Str(Str&& rhs) noexcept : Str()
+{
+    set(static_cast<Str&&>(rhs));
+}
+
 Str::Str(const char* rhs) : Str()
 {
     set(rhs);
@@ -299,6 +873,32 @@ Str::Str(const std::string& rhs) : Str()
 }
 #endif
 
+StrView::StrView(const Str& s) : Begin(s.c_str()), End(s.c_str() + s.length())
+{
+}
+
+StrFmtArg::StrFmtArg(const Str& s) : Type(ArgType_String), Int(0), StrBegin(s.c_str()), StrEnd(s.c_str() + s.length())
+{
+}
+
+// Convert each element once (so a const char* is only measured once), on the stack for small ranges
+template<typename IT>
+int Str::join_from(int idx, const StrView& sep, IT begin, IT end)
+{
+    int count = 0;
+    for (IT it = begin; it != end; ++it)
+        count++;
+    StrView local_pieces[32];
+    StrView* pieces = (count <= 32) ? local_pieces : (StrView*)STR_MEMALLOC(sizeof(StrView) * (size_t)count);
+    IT it = begin;
+    for (int n = 0; n < count; n++, ++it)
+        pieces[n] = StrView(*it);
+    int add_len = joinv_from(idx, sep, pieces, count);
+    if (pieces != local_pieces)
+        STR_MEMFREE(pieces);
+    return add_len;
+}
+
 // Literal/reference string
 class StrRef : public Str
 {
@@ -320,10 +920,14 @@ public:
     TYPENAME(const char* rhs) : Str(LOCALBUFSIZE) { set(rhs); }                     \
     TYPENAME(const TYPENAME& rhs) : Str(LOCALBUFSIZE) { set(rhs); }                 \
     TYPENAME(const std::string& rhs) : Str(LOCALBUFSIZE) { set(rhs); }              \
+    TYPENAME(Str&& rhs) noexcept : Str(LOCALBUFSIZE) { set(static_cast<Str&&>(rhs)); }      \
+    TYPENAME(TYPENAME&& rhs) noexcept : Str(LOCALBUFSIZE) { set(static_cast<Str&&>(rhs)); } \
     TYPENAME&   operator=(const char* rhs)          { set(rhs); return *this; }     \
     TYPENAME&   operator=(const Str& rhs)           { set(rhs); return *this; }     \
     TYPENAME&   operator=(const TYPENAME& rhs)      { set(rhs); return *this; }     \
     TYPENAME&   operator=(const std::string& rhs)   { set(rhs); return *this; }     \
+    TYPENAME&   operator=(Str&& rhs) noexcept       { set(static_cast<Str&&>(rhs)); return *this; } \
+    TYPENAME&   operator=(TYPENAME&& rhs) noexcept  { set(static_cast<Str&&>(rhs)); return *this; } \
 };
 
 #else
@@ -337,9 +941,13 @@ public:
     TYPENAME(const Str& rhs) : Str(LOCALBUFSIZE) { set(rhs); }                      \
     TYPENAME(const char* rhs) : Str(LOCALBUFSIZE) { set(rhs); }                     \
     TYPENAME(const TYPENAME& rhs) : Str(LOCALBUFSIZE) { set(rhs); }                 \
+    TYPENAME(Str&& rhs) noexcept : Str(LOCALBUFSIZE) { set(static_cast<Str&&>(rhs)); }      \
+    TYPENAME(TYPENAME&& rhs) noexcept : Str(LOCALBUFSIZE) { set(static_cast<Str&&>(rhs)); } \
     TYPENAME&   operator=(const char* rhs)          { set(rhs); return *this; }     \
     TYPENAME&   operator=(const Str& rhs)           { set(rhs); return *this; }     \
     TYPENAME&   operator=(const TYPENAME& rhs)      { set(rhs); return *this; }     \
+    TYPENAME&   operator=(Str&& rhs) noexcept       { set(static_cast<Str&&>(rhs)); return *this; } \
+    TYPENAME&   operator=(TYPENAME&& rhs) noexcept  { set(static_cast<Str&&>(rhs)); return *this; } \
 };
 
 #endif
@@ -347,12 +955,13 @@ public:
 // Disable PVS-Studio warning V730: Not all members of a class are initialized inside the constructor (local_buf is not initialized and that is fine)
 // -V:STR_DEFINETYPE:730
 
-// Helper to define StrXXXf constructors
+// Helper to define StrXXXf constructors, and StrXXXf::fmt() to construct using fmt_set()
 #define STR_DEFINETYPE_F(TYPENAME, TYPENAME_F)                                      \
 class TYPENAME_F : public TYPENAME                                                  \
 {                                                                                   \
 public:                                                                             \
     TYPENAME_F(const char* fmt, ...) : TYPENAME() { va_list args; va_start(args, fmt); setfv(fmt, args); va_end(args); } \
+    template<typename... ARGS> static TYPENAME fmt(typename StrFmtIdentity<StrFmtString<ARGS...> >::Type fmt, const ARGS&... args) { TYPENAME s; s.fmt_set(fmt, args...); return s; } \
 };
 
 #ifdef __clang__
@@ -385,150 +994,842 @@ STR_DEFINETYPE_F(Str32, Str32f)
 #pragma clang diagnostic pop
 #endif
 
-#endif // #ifndef STR_INCLUDED
-
 //-------------------------------------------------------------------------
-// IMPLEMENTATION
+// HASHING
 //-------------------------------------------------------------------------
 
-#ifdef STR_IMPLEMENTATION
+#if STR_SUPPORT_STD_STRING
+namespace std
+{
+    template<> struct hash<Str>
+    {
+        size_t operator()(const Str& s) const { return (size_t)s.hash(); }
+    };
+}
+#endif
 
-#include <stdio.h> // for vsnprintf
+#if STR_ENABLE_HASH_MAP
 
-// On some platform vsnprintf() takes va_list by reference and modifies it.
-// va_copy is the 'correct' way to copy a va_list but Visual Studio prior to 2013 doesn't have it.
-#ifndef va_copy
-#define va_copy(dest, src) (dest = src)
+// Keys shorter than this are stored in the slot itself, longer keys are heap allocated.
+#ifndef STR_HASHMAP_INLINE_KEY_SIZE
+#define STR_HASHMAP_INLINE_KEY_SIZE     16
 #endif
 
-// Static empty buffer we can point to for empty strings
-// Pointing to a literal increases the like-hood of getting a crash if someone attempts to write in the empty string buffer.
-char*   Str::EmptyBuffer = (char*)"\0NULL";
-
-// Clear
-void    Str::clear()
+// Open-addressing hash map with string keys (linear probing, backward shift deletion).
+// - Each slot stores the 64-bit hash next to the key, so probing rarely touches key data, and never calls strcmp().
+// - Lookups take any range of characters: const char*, Str, StrView or pointer + end pointer, without constructing a Str.
+// - Pointers to values are invalidated by insertions and erasures.
+//   StrHashMap<int> map;
+//   map["hello"] = 1;
+//   if (int* v = map.find(line_begin, line_end)) { ... }
+//   for (auto& slot : map) printf("%s: %d\n", slot.key(), slot.Value);
+template<typename V>
+class StrHashMap
 {
-    if (Owned && !is_using_local_buf())
-        STR_MEMFREE(Data);
-    if (LocalBufSize)
+public:
+    struct Slot
     {
-        Data = local_buf();
-        Data[0] = '\0';
-        Capacity = LocalBufSize - 1;
-        Owned = 1;
-    }
-    else
+        unsigned long long  Hash;
+        int                 KeyLen;             // -1 for empty slot
+        union
+        {
+            char            KeyInline[STR_HASHMAP_INLINE_KEY_SIZE];
+            char*           KeyHeap;
+        };
+        V                   Value;
+        inline const char*  key() const         { return KeyLen < STR_HASHMAP_INLINE_KEY_SIZE ? KeyInline : KeyHeap; }  // Zero-terminated
+        inline StrView      key_view() const    { return StrView(key(), key() + KeyLen); }
+    };
+
+    struct iterator
     {
-        Data = EmptyBuffer;
-        Capacity = 0;
-        Owned = 0;
-    }
-}
+        Slot*           Cur;
+        Slot*           End;
+        iterator(Slot* cur, Slot* end) : Cur(cur), End(end) { skip(); }
+        inline void     skip()                  { while (Cur < End && Cur->KeyLen < 0) Cur++; }
+        inline Slot&    operator*() const       { return *Cur; }
+        inline Slot*    operator->() const      { return Cur; }
+        inline iterator& operator++()           { Cur++; skip(); return *this; }
+        inline bool     operator!=(const iterator& rhs) const { return Cur != rhs.Cur; }
+    };
 
-// Reserve memory, preserving the current of the buffer
-// Capacity doesn't include the zero terminator, so reserve(5) is enough to store "hello".
-void    Str::reserve(int new_capacity)
+    StrHashMap() : Slots(NULL), Capacity(0), Count(0) {}
+    ~StrHashMap()                               { clear(); STR_MEMFREE(Slots); }
+
+    inline int          size() const            { return Count; }
+    inline bool         empty() const           { return Count == 0; }
+    inline iterator     begin()                 { return iterator(Slots, Slots + Capacity); }
+    inline iterator     end()                   { return iterator(Slots + Capacity, Slots + Capacity); }
+    size_t              memory_usage() const;   // Bytes allocated for slots and long keys
+
+    V*                  find(const char* key, const char* key_end = NULL)                   { Slot* slot = find_slot(key, key_end ? key_end : key + strlen(key)); return slot ? &slot->Value : NULL; }
+    const V*            find(const char* key, const char* key_end = NULL) const             { return const_cast<StrHashMap*>(this)->find(key, key_end); }
+    V*                  find(const StrView& key)                                            { return find(key.Begin, key.End); }
+    const V*            find(const StrView& key) const                                      { return find(key.Begin, key.End); }
+    inline bool         contains(const StrView& key) const                                  { return find(key) != NULL; }
+    bool                insert(const StrView& key, const V& value);                         // Return false and leave value unchanged if the key already exists
+    V&                  operator[](const StrView& key);                                     // Insert default constructed value if the key doesn't exist
+    bool                erase(const StrView& key);
+    void                clear();
+    void                reserve(int count);     // Make room for 'count' keys without rehashing
+
+private:
+    Slot*               Slots;
+    int                 Capacity;               // Power of two
+    int                 Count;
+
+    Slot*               find_slot(const char* key, const char* key_end, unsigned long long* out_hash = NULL);
+    Slot*               insert_slot(const char* key, const char* key_end, bool* out_inserted);
+    void                rehash(int new_capacity);
+    static void         move_slot(Slot* dst, Slot* src);
+
+    StrHashMap(const StrHashMap&);
+    StrHashMap&         operator=(const StrHashMap&);
+};
+
+template<typename V>
+typename StrHashMap<V>::Slot* StrHashMap<V>::find_slot(const char* key, const char* key_end, unsigned long long* out_hash)
 {
-    if (new_capacity <= Capacity)
-        return;
+    unsigned long long hash = StrHash(key, key_end);
+    if (out_hash)
+        *out_hash = hash;
+    if (Capacity == 0)
+        return NULL;
+    int key_len = (int)(key_end - key);
+    int mask = Capacity - 1;
+    for (int n = (int)(hash & (unsigned long long)mask); Slots[n].KeyLen >= 0; n = (n + 1) & mask)
+        if (Slots[n].Hash == hash && Slots[n].KeyLen == key_len && memcmp(Slots[n].key(), key, (size_t)key_len) == 0)
+            return &Slots[n];
+    return NULL;
+}
 
-    char* new_data;
-    if (new_capacity <= LocalBufSize - 1)
-    {
-        // Disowned -> LocalBuf
-        new_data = local_buf();
-        new_capacity = LocalBufSize - 1;
-    }
-    else
+template<typename V>
+typename StrHashMap<V>::Slot* StrHashMap<V>::insert_slot(const char* key, const char* key_end, bool* out_inserted)
+{
+    unsigned long long hash;
+    if (Slot* slot = find_slot(key, key_end, &hash))
     {
-        // Disowned or LocalBuf -> Heap
-        new_data = (char*)STR_MEMALLOC((size_t)(new_capacity + 1) * sizeof(char));
+        *out_inserted = false;
+        return slot;
     }
+    if ((Count + 1) * 4 > Capacity * 3)
+        rehash(Capacity ? Capacity * 2 : 16);
+    int mask = Capacity - 1;
+    int n = (int)(hash & (unsigned long long)mask);
+    while (Slots[n].KeyLen >= 0)
+        n = (n + 1) & mask;
+    Slot* slot = &Slots[n];
+    int key_len = (int)(key_end - key);
+    char* key_dst = slot->KeyInline;
+    if (key_len >= STR_HASHMAP_INLINE_KEY_SIZE)
+        key_dst = slot->KeyHeap = (char*)STR_MEMALLOC((size_t)key_len + 1);
+    memcpy(key_dst, key, (size_t)key_len);
+    key_dst[key_len] = 0;
+    slot->Hash = hash;
+    slot->KeyLen = key_len;
+    Count++;
+    *out_inserted = true;
+    return slot;
+}
 
-    // string in Data might be longer than new_capacity if it wasn't owned, don't copy too much
-#ifdef _MSC_VER
-    strncpy_s(new_data, (size_t)new_capacity + 1, Data, (size_t)new_capacity);
-#else
-    strncpy(new_data, Data, (size_t)new_capacity);
-#endif
-    new_data[new_capacity] = 0;
-
-    if (Owned && !is_using_local_buf())
-        STR_MEMFREE(Data);
+template<typename V>
+bool    StrHashMap<V>::insert(const StrView& key, const V& value)
+{
+    bool inserted;
+    Slot* slot = insert_slot(key.Begin, key.End, &inserted);
+    if (inserted)
+        new (&slot->Value) V(value);
+    return inserted;
+}
 
-    Data = new_data;
-    Capacity = new_capacity;
-    Owned = 1;
+template<typename V>
+V&      StrHashMap<V>::operator[](const StrView& key)
+{
+    bool inserted;
+    Slot* slot = insert_slot(key.Begin, key.End, &inserted);
+    if (inserted)
+        new (&slot->Value) V();
+    return slot->Value;
 }
 
-// Reserve memory, discarding the current of the buffer (if we expect to be fully rewritten)
-void    Str::reserve_discard(int new_capacity)
+template<typename V>
+void    StrHashMap<V>::move_slot(Slot* dst, Slot* src)
 {
-    if (new_capacity <= Capacity)
-        return;
+    dst->Hash = src->Hash;
+    dst->KeyLen = src->KeyLen;
+    memcpy(dst->KeyInline, src->KeyInline, sizeof(dst->KeyInline)); // Also copies KeyHeap
+    new (&dst->Value) V(static_cast<V&&>(src->Value));
+    src->Value.~V();
+    src->KeyLen = -1;
+}
 
-    if (Owned && !is_using_local_buf())
-        STR_MEMFREE(Data);
+template<typename V>
+bool    StrHashMap<V>::erase(const StrView& key)
+{
+    Slot* slot = find_slot(key.Begin, key.End);
+    if (slot == NULL)
+        return false;
+    if (slot->KeyLen >= STR_HASHMAP_INLINE_KEY_SIZE)
+        STR_MEMFREE(slot->KeyHeap);
+    slot->Value.~V();
+    slot->KeyLen = -1;
+    Count--;
 
-    if (new_capacity <= LocalBufSize - 1)
+    // Backward shift: move following entries into the hole unless they are already at or after their home position
+    int mask = Capacity - 1;
+    int hole = (int)(slot - Slots);
+    for (int n = (hole + 1) & mask; Slots[n].KeyLen >= 0; n = (n + 1) & mask)
     {
-        // Disowned -> LocalBuf
-        Data = local_buf();
-        Capacity = LocalBufSize - 1;
+        int home = (int)(Slots[n].Hash & (unsigned long long)mask);
+        if (((n - home) & mask) >= ((n - hole) & mask))
+        {
+            move_slot(&Slots[hole], &Slots[n]);
+            hole = n;
+        }
     }
-    else
+    return true;
+}
+
+template<typename V>
+void    StrHashMap<V>::clear()
+{
+    for (int n = 0; n < Capacity; n++)
     {
-        // Disowned or LocalBuf -> Heap
-        Data = (char*)STR_MEMALLOC((size_t)(new_capacity + 1) * sizeof(char));
-        Capacity = new_capacity;
+        if (Slots[n].KeyLen < 0)
+            continue;
+        if (Slots[n].KeyLen >= STR_HASHMAP_INLINE_KEY_SIZE)
+            STR_MEMFREE(Slots[n].KeyHeap);
+        Slots[n].Value.~V();
+        Slots[n].KeyLen = -1;
     }
-    Owned = 1;
+    Count = 0;
 }
 
-void    Str::shrink_to_fit()
+template<typename V>
+void    StrHashMap<V>::reserve(int count)
 {
-    if (!Owned || is_using_local_buf())
-        return;
-    int new_capacity = length();
-    if (Capacity <= new_capacity)
-        return;
+    int new_capacity = Capacity ? Capacity : 16;
+    while (count * 4 > new_capacity * 3)
+        new_capacity *= 2;
+    if (new_capacity > Capacity)
+        rehash(new_capacity);
+}
 
-    char* new_data = (char*)STR_MEMALLOC((size_t)(new_capacity + 1) * sizeof(char));
-    memcpy(new_data, Data, (size_t)(new_capacity + 1));
-    STR_MEMFREE(Data);
-    Data = new_data;
+template<typename V>
+void    StrHashMap<V>::rehash(int new_capacity)
+{
+    Slot* old_slots = Slots;
+    int old_capacity = Capacity;
+    Slots = (Slot*)STR_MEMALLOC((size_t)new_capacity * sizeof(Slot));
     Capacity = new_capacity;
+    for (int n = 0; n < new_capacity; n++)
+        Slots[n].KeyLen = -1;
+    int mask = new_capacity - 1;
+    for (int n = 0; n < old_capacity; n++)
+    {
+        if (old_slots[n].KeyLen < 0)
+            continue;
+        int dst_n = (int)(old_slots[n].Hash & (unsigned long long)mask);
+        while (Slots[dst_n].KeyLen >= 0)
+            dst_n = (dst_n + 1) & mask;
+        move_slot(&Slots[dst_n], &old_slots[n]);
+    }
+    STR_MEMFREE(old_slots);
 }
 
-// FIXME: merge setfv() and appendfv()?
-int     Str::setfv(const char* fmt, va_list args)
+template<typename V>
+size_t  StrHashMap<V>::memory_usage() const
 {
-    // Needed for portability on platforms where va_list are passed by reference and modified by functions
-    va_list args2;
-    va_copy(args2, args);
+    size_t bytes = (size_t)Capacity * sizeof(Slot);
+    for (int n = 0; n < Capacity; n++)
+        if (Slots[n].KeyLen >= STR_HASHMAP_INLINE_KEY_SIZE)
+            bytes += (size_t)Slots[n].KeyLen + 1;
+    return bytes;
+}
 
-    // MSVC returns -1 on overflow when writing, which forces us to do two passes
+#endif // #if STR_ENABLE_HASH_MAP
+
+//-------------------------------------------------------------------------
+// STRING INTERNING
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_INTERNER
+
+// Handle to a string stored in a StrInterner. This is a non-owned reference (as with StrRef), valid as long as the StrInterner is alive.
+// Equality between handles from the same StrInterner is a pointer comparison. Don't modify it: it would turn into a regular owned copy.
+class StrInterned : public StrRef
+{
+    unsigned long long  Hash;
+    int                 Id;
+    friend class StrInterner;
+    StrInterned(const char* s, unsigned long long hash, int id) : StrRef(s), Hash(hash), Id(id) {}
+public:
+    StrInterned() : StrRef(NULL), Hash(0), Id(-1) {}
+    StrInterned(const StrInterned& rhs) : StrRef(rhs.c_str()), Hash(rhs.Hash), Id(rhs.Id) {}
+    StrInterned&        operator=(const StrInterned& rhs)       { set_ref(rhs.c_str()); Hash = rhs.Hash; Id = rhs.Id; return *this; }
+    inline unsigned long long hash() const                      { return Hash; }   // Same as Str::hash(), without rehashing
+    inline int          id() const                              { return Id; }   // Unique per StrInterner, -1 for default constructed handle
+    using Str::operator==;                                      // Compare with const char*, Str, etc. by contents
+    using Str::operator!=;
+    inline bool         operator==(const StrInterned& rhs) const{ return c_str() == rhs.c_str(); }
+    inline bool         operator!=(const StrInterned& rhs) const{ return c_str() != rhs.c_str(); }
+};
+
+// Deduplicate strings into arena-backed storage. Strings are never moved nor freed until the StrInterner is destroyed.
+// Thread-safe: the table is split in shards, each protected by its own lock.
+struct StrInternerShard;
+class STR_API StrInterner
+{
+    StrInternerShard*   Shards;
+public:
+    StrInterner();
+    ~StrInterner();
+    StrInterned         intern(const char* s, const char* s_end = NULL);
+    StrInterned         intern(const Str& s)                    { return intern(s.c_str(), s.c_str() + s.length()); }
+    bool                find(const char* s, const char* s_end, StrInterned* out) const;  // Lookup without inserting
+    int                 size() const;                           // Number of unique strings
+    size_t              memory_usage() const;                   // Bytes allocated for storage and tables
+
+private:
+    StrInterner(const StrInterner&);
+    StrInterner&        operator=(const StrInterner&);
+};
+
+#endif // #if STR_ENABLE_INTERNER
+
+//-------------------------------------------------------------------------
+// SPLITTING
+//-------------------------------------------------------------------------
+
+enum StrSplitFlags_
+{
+    StrSplitFlags_None              = 0,
+    StrSplitFlags_SkipEmpty         = 1 << 0,   // Don't output empty fields (checked after trimming)
+    StrSplitFlags_TrimWhitespace    = 1 << 1,   // Trim spaces, tabs and end of lines around each field
+    StrSplitFlags_AnyOf             = 1 << 2,   // Separator string is a set of characters, any of them is a separator (default: separator is a substring)
+};
+typedef int StrSplitFlags;
+
+// Split a range of characters without allocating. Output fields are StrView pointing into the source, use Str::set(StrView) to keep a copy.
+//   StrSplit split(line, ',');
+//   for (StrView field; split.next(&field); ) { ... }
+//   for (StrView field : StrSplit(line, ", ", StrSplitFlags_SkipEmpty)) { ... }
+// 'max_splits' limits the number of separators consumed, the remaining input is output as the last field. -1 for no limit.
+class STR_API StrSplit
+{
+    const char*         Cur;
+    const char*         End;
+    const char*         Separator;
+    int                 SeparatorLen;
+    StrSplitFlags       Flags;
+    int                 SplitsLeft;
+    bool                Done;
+    unsigned int        SeparatorSet[256 / 32]; // With StrSplitFlags_AnyOf
+public:
+    StrSplit(const StrView& src, char separator, StrSplitFlags flags = 0, int max_splits = -1);
+    StrSplit(const StrView& src, const char* separator, StrSplitFlags flags = 0, int max_splits = -1);
+    bool                next(StrView* out_field);
+
+    struct iterator
+    {
+        StrSplit*       Split;
+        StrView         Field;
+        inline StrView  operator*() const                       { return Field; }
+        inline bool     operator!=(const iterator& rhs) const   { return Split != rhs.Split; }
+        inline iterator& operator++()                           { if (!Split->next(&Field)) Split = NULL; return *this; }
+    };
+    inline iterator     begin()                                 { iterator it = { this, StrView() }; return ++it; }
+    inline iterator     end()                                   { iterator it = { NULL, StrView() }; return it; }
+};
+
+//-------------------------------------------------------------------------
+// SORTING
+//-------------------------------------------------------------------------
+
+// Sort arrays of strings in the same order as Str::operator<. Faster than std::sort() with strcmp() on large arrays:
+// - MSD radix sort on the next 8 bytes of each string packed into an integer, stored next to the string pointer,
+//   so most passes don't read string memory. Buckets of less than 64 strings use multikey quicksort on those keys.
+// - The following 8 bytes are only loaded for groups sharing the same key.
+// - Elements are only moved at the end, in order. Temporary storage is 48 bytes per element (on 64-bits).
+//   StrSort(names.data(), names.data() + names.size());  // e.g. std::vector<Str> names
+STR_API void    StrSort(Str* begin, Str* end);
+STR_API void    StrSort(StrRef* begin, StrRef* end);
+STR_API void    StrSort(StrView* begin, StrView* end);
+
+//-------------------------------------------------------------------------
+// BUILDER
+//-------------------------------------------------------------------------
+
+// Assemble large outputs (e.g. multi-MB dumps) without reallocating and copying what was already built.
+// Pieces are stored in a list of fixed-size chunks. At the end, flatten into a Str with a single exact-size allocation,
+// or stream the chunks to a FILE* or file descriptor without ever holding a contiguous copy.
+//   StrBuilder b;
+//   b.append("{ \"count\": "); b.append_int(n); b.append(" }");
+//   Str out; b.flatten(out);
+struct StrBuilderChunk;
+class STR_API StrBuilder
+{
+    StrBuilderChunk*    First;
+    StrBuilderChunk*    Last;
+    size_t              TotalLen;
+    int                 ChunkSize;
+public:
+    StrBuilder(int chunk_size = 64 * 1024);
+    ~StrBuilder();
+    void                clear();
+    inline size_t       length() const                          { return TotalLen; }
+    inline bool         empty() const                           { return TotalLen == 0; }
+
+    void                append(char c);
+    void                append(const char* s, const char* s_end = NULL);
+    inline void         append(const StrView& s)                { append(s.Begin, s.End); }
+    void                appendf(const char* fmt, ...);
+    void                appendfv(const char* fmt, va_list args);
+    void                append_int(long long v);
+    void                append_uint(unsigned long long v);
+    void                append_hex(unsigned long long v);
+    void                append_float(double v, int precision = 6);
+
+    void                flatten(Str& out) const;                // Copy everything into 'out' (replacing its contents), allocating at most once
+    bool                write(FILE* f) const;                   // Write all chunks with fwrite(), return false on error
+    bool                write(int fd) const;                    // Write all chunks with writev() (or _write() on Windows), return false on error
+
+private:
+    char*               alloc_contiguous(int size);             // Return pointer to 'size' writable bytes in the last chunk
+    StrBuilder(const StrBuilder&);
+    StrBuilder&         operator=(const StrBuilder&);
+};
+
+//-------------------------------------------------------------------------
+// FILES
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_FILES
+
+// Read lines from a file descriptor in large blocks. Lines are output without their '\n' (nor the '\r' of a "\r\n" pair).
+// The internal buffer grows to fit the longest line, so in steady state reading allocates nothing.
+//   StrLineReader reader;
+//   if (reader.open("log.txt"))
+//       for (Str256 line; reader.next(&line); ) { ... }     // Reuse the capacity of 'line'
+//   for (StrView line; reader.next(&line); ) { ... }        // Zero-copy, view is valid until the next call
+class STR_API StrLineReader
+{
+    char*               Buf;
+    int                 BufSize;
+    int                 Begin;                  // Start of unread data in Buf
+    int                 End;                    // End of data read in Buf
+    int                 ScanFrom;               // Position from which we haven't searched for '\n' yet
+    int                 Fd;
+    bool                OwnFd;                  // Set when opened with open(), we close it
+    bool                Eof;
+    bool                Error;
+    int                 LineNumber;
+public:
+    StrLineReader(int fd = -1, int block_size = 64 * 1024);    // Doesn't take ownership of 'fd'
+    ~StrLineReader();
+    bool                open(const char* path);
+    void                close();
+    bool                next(StrView* out_line);
+    bool                next(Str* out_line);
+    inline int          line_number() const                     { return LineNumber; }  // 1-based number of the last line returned
+    inline bool         error() const                           { return Error; }
+
+private:
+    StrLineReader(const StrLineReader&);
+    StrLineReader&      operator=(const StrLineReader&);
+};
+
+#endif // #if STR_ENABLE_FILES
+
+//-------------------------------------------------------------------------
+// TABLE
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_TABLE
+
+// Packed table of strings: characters of all strings are stored in one arena, each followed by a zero terminator,
+// and indexed by an array of offsets. Costs 8 bytes + length + 1 per string, instead of sizeof(Str) + a heap block.
+// - operator[] returns a StrView, c_str() a zero-terminated pointer (e.g. for StrRef). Both are invalidated by modifications.
+// - set() and erase() leave unused characters in the arena, compact() reclaims them.
+// - save() writes a flat binary blob (native endianness). load() maps it back without parsing: the table is read-only
+//   until modified, at which point it is copied to the heap. Only the blob header is validated, load trusted files.
+//   StrTable table;
+//   table.append_lines(file_contents);
+//   for (int n = 0; n < table.size(); n++) { StrView s = table[n]; ... }
+class STR_API StrTable
+{
+public:
+    struct Entry
+    {
+        unsigned int    Offset;
+        unsigned int    Length;
+    };
+
+    StrTable();
+    ~StrTable();
+    inline int          size() const                            { return EntriesCount; }
+    inline bool         empty() const                           { return EntriesCount == 0; }
+    inline StrView      operator[](int idx) const               { STR_ASSERT(idx >= 0 && idx < EntriesCount); const char* s = Chars + Entries[idx].Offset; return StrView(s, s + Entries[idx].Length); }
+    inline const char*  c_str(int idx) const                    { STR_ASSERT(idx >= 0 && idx < EntriesCount); return Chars + Entries[idx].Offset; }
+    inline int          length(int idx) const                   { STR_ASSERT(idx >= 0 && idx < EntriesCount); return (int)Entries[idx].Length; }
+    inline size_t       chars_size() const                      { return CharsSize; }   // Arena usage, including zero terminators and unused characters
+
+    int                 append(const StrView& s);               // Return index of the new string
+    int                 append_lines(const StrView& text);      // Append each line of 'text' (without "\n" or "\r\n"), return number of lines added
+    void                set(int idx, const StrView& s);
+    void                erase(int idx);
+    void                reserve(int entries_count, size_t chars_size);
+    void                compact();                              // Remove unused characters, shrink allocations to fit
+    void                clear();
+
+    bool                save(const char* path) const;
+    bool                load(const char* path);
+    bool                load_from_memory(const void* data, size_t size);   // 'data' must stay valid and unmodified while the table uses it
+
+private:
+    char*               Chars;
+    size_t              CharsSize;
+    size_t              CharsCapacity;
+    Entry*              Entries;
+    int                 EntriesCount;
+    int                 EntriesCapacity;
+    bool                Owned;                  // False after load()/load_from_memory(): Chars and Entries point into the blob
+    void*               MappedBase;             // With load(): mapping to release
+    size_t              MappedSize;
+
+    void                make_owned();
+    void                grow(int add_entries, size_t add_chars);
+    StrTable(const StrTable&);
+    StrTable&           operator=(const StrTable&);
+};
+
+#endif // #if STR_ENABLE_TABLE
+
+//-------------------------------------------------------------------------
+// LOG BUFFER
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_LOG_BUFFER
+
+// Multi-producer log buffer: any thread appends records, one consumer thread drains them in order to a file descriptor.
+// Producers don't take locks: each record reserves its slice of a preallocated ring with one atomic add, is formatted
+// directly into it, then published. When the ring is full producers wait for the consumer, so something must keep draining.
+// Records longer than a quarter of the ring are truncated. No '\n' is added.
+//   StrLogBuffer log(4 * 1024 * 1024);
+//   log.appendf("[%s] loaded %d items\n", name, count);   // Any thread
+//   while (running) { if (log.drain(fd) == 0) sleep_a_bit(); }    // Consumer thread
+struct StrLogBufferData;
+class STR_API StrLogBuffer
+{
+    StrLogBufferData*   Data;
+public:
+    StrLogBuffer(int size = 1024 * 1024);       // Rounded up to a power of two
+    ~StrLogBuffer();                            // Pending records are discarded, drain() first
+    int                 size() const;
+
+    void                append(const char* s, const char* s_end = NULL);
+    inline void         append(const StrView& s)                { append(s.Begin, s.End); }
+    void                appendf(const char* fmt, ...);
+    void                appendfv(const char* fmt, va_list args);
+
+    // Consumer side: only one thread may drain at a time. Return number of records drained, -1 on write error.
+    int                 drain(int fd);          // Write records with writev() (or _write() on Windows)
+    int                 drain(Str& out);        // Append records to 'out'
+
+private:
+    StrLogBuffer(const StrLogBuffer&);
+    StrLogBuffer&       operator=(const StrLogBuffer&);
+};
+
+#endif // #if STR_ENABLE_LOG_BUFFER
+
+//-------------------------------------------------------------------------
+// SCRATCH
+//-------------------------------------------------------------------------
+
+// Temporary strings formatted into a per-thread ring of STR_SCRATCH_RING_SIZE reusable heap buffers.
+// Once buffers have grown this doesn't allocate, and unlike a StrXXXf temporary it only uses a few bytes of stack.
+// The result is valid until the ring wraps around, don't store it: copy it into a Str if you need to keep it.
+//   fopen(StrScratch::f("%s/%s.tmp", folder, filename).c_str(), "rb");
+//   map.find(StrScratch::fmt("{}:{}", category, id));
+class STR_API StrScratchRef
+{
+    const char*         Data;
+    int                 Length;
+#if STR_SCRATCH_CHECK
+    unsigned int        Generation;
+    const unsigned int* SlotGeneration;         // Bumped when the buffer is reused
+    inline void         check() const                           { STR_ASSERT(*SlotGeneration == Generation && "StrScratchRef used after its buffer was reused, copy it into a Str to keep it"); }
+#else
+    inline void         check() const                           { }
+#endif
+    friend class StrScratch;
+public:
+    inline const char*  c_str() const                           { check(); return Data; }
+    inline int          length() const                          { check(); return Length; }
+    inline bool         empty() const                           { check(); return Length == 0; }
+    inline operator     StrView() const                         { check(); return StrView(Data, Data + Length); }
+};
+
+class STR_API StrScratch
+{
+public:
+    static StrScratchRef f(const char* fmt, ...);
+    static StrScratchRef fv(const char* fmt, va_list args);
+    template<typename... ARGS> static StrScratchRef fmt(typename StrFmtIdentity<StrFmtString<ARGS...> >::Type fmt, const ARGS&... args) { const StrFmtArg a[] = { StrFmtArg(args)..., StrFmtArg() }; return fmtv(fmt.Fmt, a, (int)sizeof...(ARGS)); }
+    template<typename... ARGS> static StrScratchRef concat(const ARGS&... args) { const StrView v[] = { StrView(args)..., StrView() }; return joinv(StrView(), v, (int)sizeof...(ARGS)); }
+    static StrScratchRef fmtv(const char* fmt, const StrFmtArg* args, int args_count);
+    static StrScratchRef joinv(const StrView& sep, const StrView* pieces, int pieces_count);
+
+private:
+    static Str*         acquire(StrScratchRef* out_ref);
+};
+
+#endif // #ifndef STR_INCLUDED
+
+//-------------------------------------------------------------------------
+// IMPLEMENTATION
+//-------------------------------------------------------------------------
+
+#ifdef STR_IMPLEMENTATION
+
+#include <stdio.h> // for vsnprintf
+#include <math.h>  // for floor, fabs
+#include <new>     // for placement new
+
+// On some platform vsnprintf() takes va_list by reference and modifies it.
+// va_copy is the 'correct' way to copy a va_list but Visual Studio prior to 2013 doesn't have it.
+#ifndef va_copy
+#define va_copy(dest, src) (dest = src)
+#endif
+
+// Static empty buffer we can point to for empty strings
+// Pointing to a literal increases the like-hood of getting a crash if someone attempts to write in the empty string buffer.
+char*   Str::EmptyBuffer = (char*)"\0NULL";
+
+// Clear
+void    Str::clear()
+{
+    // Already in the local buffer: nothing to free. Also keeps GCC from tracing free_data() into the local buffer (-Warray-bounds).
+    if (LocalBufSize && Data == local_buf())
+    {
+        Data[0] = '\0';
+        set_length(0);
+        return;
+    }
+    free_data();
+    if (LocalBufSize)
+    {
+        Data = local_buf();
+        Data[0] = '\0';
+        Capacity = LocalBufSize - 1;
+        Owned = 1;
+    }
+    else
+    {
+        Data = EmptyBuffer;
+        Capacity = 0;
+        Owned = 0;
+    }
+    set_length(0);
+}
+
+// Reserve memory, preserving the current of the buffer
+// Capacity doesn't include the zero terminator, so reserve(5) is enough to store "hello".
+// Capacity grows geometrically so that appending N pieces only reallocate O(log N) times.
+void    Str::reserve(int new_capacity)
+{
+    if (cur_owned() && new_capacity <= cur_capacity())
+        return;
+
+    long long grown_capacity = cur_owned() ? STR_GROW_CAPACITY((long long)cur_capacity()) : 0;
+    if (grown_capacity > STR_CAPACITY_MAX)
+        grown_capacity = STR_CAPACITY_MAX;
+    reserve_exact(new_capacity > grown_capacity ? new_capacity : (int)grown_capacity);
+}
+
+// Reserve memory, preserving the current of the buffer, without applying growth policy
+void    Str::reserve_exact(int new_capacity)
+{
+    if (cur_owned() && new_capacity <= cur_capacity())
+        return;
+    if (shared() && new_capacity < length())
+        new_capacity = length(); // Detaching from a shared buffer always preserve contents
+    STR_ASSERT(new_capacity <= STR_CAPACITY_MAX);
+    int local_buf_size = cur_local_buf_size();
+
+#if STR_USE_INLINE_BUFFER
+    if (local_buf_size == 0 && new_capacity <= inline_capacity())
+    {
+        // Disowned -> Inline: characters overwrite the header fields, so release the current buffer first
+        char tmp[sizeof(Str)];
+        int len = (int)strnlen(Data, (size_t)new_capacity);
+        memcpy(tmp, Data, (size_t)len);
+        free_data();
+        Data = inline_buf();
+        memcpy(Data, tmp, (size_t)len);
+        Data[len] = 0;
+        return;
+    }
+#endif
+
+    if (cur_owned() && !is_using_local_buf())
+    {
+        // Heap -> Heap: contents and length are preserved
+        STR_STATS(StrStatsAdd(local_buf_size, StrStatsCounter_Reallocs, 1));
+        STR_STATS(StrStatsAdd(local_buf_size, StrStatsCounter_HeapBytes, (unsigned long long)new_capacity + 1));
+#ifdef STR_MEMREALLOC
+        Data = (char*)STR_MEMREALLOC(Data, (size_t)(new_capacity + 1) * sizeof(char));
+#else
+        char* new_data = (char*)STR_MEMALLOC((size_t)(new_capacity + 1) * sizeof(char));
+        memcpy(new_data, Data, (size_t)length() + 1);
+        STR_MEMFREE(Data);
+        Data = new_data;
+#endif
+        Capacity = new_capacity;
+        return;
+    }
+
+    char* new_data;
+    if (new_capacity <= local_buf_size - 1)
+    {
+        // Disowned -> LocalBuf
+        new_data = local_buf();
+        new_capacity = local_buf_size - 1;
+    }
+    else
+    {
+        // Disowned or LocalBuf -> Heap
+        new_data = (char*)STR_MEMALLOC((size_t)(new_capacity + 1) * sizeof(char));
+        STR_STATS(StrStatsAdd(local_buf_size, StrStatsCounter_Spills, 1));
+        STR_STATS(StrStatsAdd(local_buf_size, StrStatsCounter_HeapBytes, (unsigned long long)new_capacity + 1));
+    }
+
+    // String in Data might be longer than new_capacity if it wasn't owned, don't copy too much
+#if STR_TRACK_LENGTH
+    int len = length();
+    if (len > new_capacity)
+        len = new_capacity;
+#else
+    int len = (int)strnlen(Data, (size_t)new_capacity);
+#endif
+    memcpy(new_data, Data, (size_t)len);
+    new_data[len] = 0;
+    free_data();
+
+    Data = new_data;
+    Capacity = new_capacity;
+    Owned = 1;
+    set_length(len);
+}
+
+// Reserve memory, discarding the current of the buffer (if we expect to be fully rewritten)
+void    Str::reserve_discard(int new_capacity)
+{
+    if (cur_owned() && new_capacity <= cur_capacity())
+        return;
+    STR_ASSERT(new_capacity <= STR_CAPACITY_MAX);
+
+    STR_STATS(bool was_heap = cur_owned() && !is_using_local_buf());
+    int local_buf_size = cur_local_buf_size();
+    free_data();
+
+#if STR_USE_INLINE_BUFFER
+    if (local_buf_size == 0 && new_capacity <= inline_capacity())
+    {
+        // Disowned -> Inline (no header fields to update)
+        Data = inline_buf();
+        Data[0] = 0;
+        return;
+    }
+#endif
+
+    if (new_capacity <= local_buf_size - 1)
+    {
+        // Disowned -> LocalBuf
+        Data = local_buf();
+        Capacity = local_buf_size - 1;
+    }
+    else
+    {
+        // Disowned or LocalBuf or Heap -> Heap
+        Data = (char*)STR_MEMALLOC((size_t)(new_capacity + 1) * sizeof(char));
+        Capacity = new_capacity;
+        STR_STATS(StrStatsAdd(local_buf_size, was_heap ? StrStatsCounter_Reallocs : StrStatsCounter_Spills, 1));
+        STR_STATS(StrStatsAdd(local_buf_size, StrStatsCounter_HeapBytes, (unsigned long long)new_capacity + 1));
+    }
+    Data[0] = 0;
+    Owned = 1;
+    set_length(0);
+}
+
+void    Str::shrink_to_fit()
+{
+    if (!cur_owned() || is_using_local_buf())
+        return;
+    int new_capacity = length();
+    if (Capacity <= new_capacity)
+        return;
+#if STR_USE_INLINE_BUFFER
+    if (LocalBufSize == 0 && new_capacity <= inline_capacity())
+    {
+        // Heap -> Inline
+        char* old_data = Data;
+        Data = inline_buf();
+        memcpy(Data, old_data, (size_t)(new_capacity + 1));
+        STR_MEMFREE(old_data);
+        return;
+    }
+#endif
+
+#ifdef STR_MEMREALLOC
+    Data = (char*)STR_MEMREALLOC(Data, (size_t)(new_capacity + 1) * sizeof(char));
+#else
+    char* new_data = (char*)STR_MEMALLOC((size_t)(new_capacity + 1) * sizeof(char));
+    memcpy(new_data, Data, (size_t)(new_capacity + 1));
+    STR_MEMFREE(Data);
+    Data = new_data;
+#endif
+    Capacity = new_capacity;
+}
+
+// FIXME: merge setfv() and appendfv()?
+int     Str::setfv(const char* fmt, va_list args)
+{
+    // Needed for portability on platforms where va_list are passed by reference and modified by functions
+    va_list args2;
+    va_copy(args2, args);
+    char* pinned = shared_pin(); // Arguments may point into our shared buffer, which reserve_discard() releases
+
+    // MSVC returns -1 on overflow when writing, which forces us to do two passes
     // FIXME-OPT: Find a way around that.
 #ifdef _MSC_VER
     int len = vsnprintf(NULL, 0, fmt, args);
     STR_ASSERT(len >= 0);
 
-    if (Capacity < len)
+    if (!cur_owned() || cur_capacity() < len)
+    {
+        STR_STATS(StrStatsAdd(cur_local_buf_size(), StrStatsCounter_FormatRetries, 1));
         reserve_discard(len);
+    }
     len = vsnprintf(Data, (size_t)len + 1, fmt, args2);
 #else
     // First try
-    int len = vsnprintf(Owned ? Data : NULL, Owned ? (size_t)(Capacity + 1): 0, fmt, args);
+    int len = vsnprintf(cur_owned() ? Data : NULL, cur_owned() ? (size_t)(cur_capacity() + 1): 0, fmt, args);
     STR_ASSERT(len >= 0);
 
-    if (Capacity < len)
+    if (!cur_owned() || cur_capacity() < len)
     {
+        STR_STATS(StrStatsAdd(cur_local_buf_size(), StrStatsCounter_FormatRetries, 1));
         reserve_discard(len);
         len = vsnprintf(Data, (size_t)len + 1, fmt, args2);
     }
 #endif
 
-    STR_ASSERT(Owned);
+    STR_ASSERT(cur_owned());
+    set_length(len);
+    if (pinned)
+        shared_release(pinned);
     return len;
 }
 
@@ -543,15 +1844,24 @@ int     Str::setf(const char* fmt, ...)
 
 int     Str::setfv_nogrow(const char* fmt, va_list args)
 {
-    STR_ASSERT(Owned);
+    char* pinned = NULL;
+    if (shared())
+    {
+        pinned = shared_pin(); // Arguments may point into our shared buffer, which reserve_discard() releases
+        reserve_discard(Capacity);
+    }
+    STR_ASSERT(cur_owned());
 
-    if (Capacity == 0)
+    int capacity = cur_capacity();
+    if (capacity == 0)
         return 0;
 
-    int w = vsnprintf(Data, (size_t)(Capacity + 1), fmt, args);
-    Data[Capacity] = 0;
-    Owned = 1;
-    return (w == -1) ? Capacity : w;
+    int w = vsnprintf(Data, (size_t)(capacity + 1), fmt, args);
+    Data[capacity] = 0;
+    set_length((w == -1 || w > capacity) ? capacity : w);
+    if (pinned)
+        shared_release(pinned);
+    return (w == -1) ? capacity : w;
 }
 
 int     Str::setf_nogrow(const char* fmt, ...)
@@ -566,11 +1876,12 @@ int     Str::setf_nogrow(const char* fmt, ...)
 int     Str::append_from(int idx, char c)
 {
     int add_len = 1;
-    if (Capacity < idx + add_len)
+    if (!cur_owned() || cur_capacity() < idx + add_len)
         reserve(idx + add_len);
     Data[idx] = c;
     Data[idx + add_len] = 0;
-    STR_ASSERT(Owned);
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
     return add_len;
 }
 
@@ -579,11 +1890,25 @@ int     Str::append_from(int idx, const char* s, const char* s_end)
     if (!s_end)
         s_end = s + strlen(s);
     int add_len = (int)(s_end - s);
-    if (Capacity < idx + add_len)
+    char* pinned = NULL;
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+    {
+        if (cur_owned() && points_into(s))
+        {
+            // Source would be freed by reallocating
+            Str tmp;
+            tmp.set(s, s_end);
+            return append_from(idx, tmp.c_str(), tmp.c_str() + add_len);
+        }
+        pinned = shared_pin(); // Source may point into our shared buffer, which reserve() releases
         reserve(idx + add_len);
-    memcpy(Data + idx, (const void*)s, (size_t)add_len);
+    }
+    memmove(Data + idx, (const void*)s, (size_t)add_len); // Source may also be a part of our own buffer
     Data[idx + add_len] = 0; // Our source data isn't necessarily zero terminated
-    STR_ASSERT(Owned);
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    if (pinned)
+        shared_release(pinned);
     return add_len;
 }
 
@@ -593,6 +1918,7 @@ int     Str::appendfv_from(int idx, const char* fmt, va_list args)
     // Needed for portability on platforms where va_list are passed by reference and modified by functions
     va_list args2;
     va_copy(args2, args);
+    char* pinned = shared_pin(); // Arguments may point into our shared buffer, which reserve() releases
 
     // MSVC returns -1 on overflow when writing, which forces us to do two passes
     // FIXME-OPT: Find a way around that.
@@ -600,22 +1926,29 @@ int     Str::appendfv_from(int idx, const char* fmt, va_list args)
     int add_len = vsnprintf(NULL, 0, fmt, args);
     STR_ASSERT(add_len >= 0);
 
-    if (Capacity < idx + add_len)
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+    {
+        STR_STATS(StrStatsAdd(cur_local_buf_size(), StrStatsCounter_FormatRetries, 1));
         reserve(idx + add_len);
+    }
     add_len = vsnprintf(Data + idx, add_len + 1, fmt, args2);
 #else
     // First try
-    int add_len = vsnprintf(Owned ? Data + idx : NULL, Owned ? (size_t)(Capacity + 1 - idx) : 0, fmt, args);
+    int add_len = vsnprintf(cur_owned() ? Data + idx : NULL, cur_owned() ? (size_t)(cur_capacity() + 1 - idx) : 0, fmt, args);
     STR_ASSERT(add_len >= 0);
 
-    if (Capacity < idx + add_len)
+    if (!cur_owned() || cur_capacity() < idx + add_len)
     {
+        STR_STATS(StrStatsAdd(cur_local_buf_size(), StrStatsCounter_FormatRetries, 1));
         reserve(idx + add_len);
         add_len = vsnprintf(Data + idx, (size_t)add_len + 1, fmt, args2);
     }
 #endif
 
-    STR_ASSERT(Owned);
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    if (pinned)
+        shared_release(pinned);
     return add_len;
 }
 
@@ -655,6 +1988,3666 @@ int     Str::appendf(const char* fmt, ...)
     return len;
 }
 
+int     Str::joinv_from(int idx, const StrView& sep, const StrView* pieces, int pieces_count)
+{
+    // Measure everything first. Pieces pointing into our own buffer would be invalidated by reserve() or overwritten while copying.
+    const char* buf_begin = Data;
+    const char* buf_end = Data + cur_capacity() + 1;
+    int sep_len = sep.length();
+    int add_len = (pieces_count > 1) ? sep_len * (pieces_count - 1) : 0;
+    bool aliased = sep_len > 0 && sep.Begin >= buf_begin && sep.Begin < buf_end;
+    for (int n = 0; n < pieces_count; n++)
+    {
+        add_len += pieces[n].length();
+        aliased |= pieces[n].Begin >= buf_begin && pieces[n].Begin < buf_end;
+    }
+    if (aliased)
+    {
+        Str tmp;
+        tmp.reserve(idx + add_len);
+        memcpy(tmp.Data, Data, (size_t)idx);
+        tmp.joinv_from(idx, sep, pieces, pieces_count);
+        set(tmp.c_str(), tmp.c_str() + idx + add_len);
+        return add_len;
+    }
+
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    char* p = Data + idx;
+    for (int n = 0; n < pieces_count; n++)
+    {
+        if (n > 0 && sep_len > 0)
+        {
+            memcpy(p, sep.Begin, (size_t)sep_len);
+            p += sep_len;
+        }
+        int piece_len = pieces[n].length();
+        if (piece_len > 0)
+            memcpy(p, pieces[n].Begin, (size_t)piece_len);
+        p += piece_len;
+    }
+    *p = 0;
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    return add_len;
+}
+
+
+//-------------------------------------------------------------------------
+// Numbers
+//-------------------------------------------------------------------------
+
+static const char StrDigitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869"
+    "707172737475767778798081828384858687888990919293949596979899";
+
+static int StrCountDigits10(unsigned long long v)
+{
+    int n = 1;
+    for (;;)
+    {
+        if (v < 10) return n;
+        if (v < 100) return n + 1;
+        if (v < 1000) return n + 2;
+        if (v < 10000) return n + 3;
+        v /= 10000u;
+        n += 4;
+    }
+}
+
+// Write digits backward, ending right before 'end'
+static void StrWriteDigits10(char* end, unsigned long long v)
+{
+    while (v >= 100)
+    {
+        const char* pair = &StrDigitPairs[(v % 100) * 2];
+        v /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (v >= 10)
+    {
+        const char* pair = &StrDigitPairs[v * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    else
+    {
+        *--end = (char)('0' + v);
+    }
+}
+
+int     Str::append_uint_from(int idx, unsigned long long v)
+{
+    int add_len = StrCountDigits10(v);
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    StrWriteDigits10(Data + idx + add_len, v);
+    Data[idx + add_len] = 0;
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    return add_len;
+}
+
+int     Str::append_int_from(int idx, long long v)
+{
+    if (v >= 0)
+        return append_uint_from(idx, (unsigned long long)v);
+    unsigned long long abs_v = 0ULL - (unsigned long long)v;
+    int add_len = 1 + StrCountDigits10(abs_v);
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    Data[idx] = '-';
+    StrWriteDigits10(Data + idx + add_len, abs_v);
+    Data[idx + add_len] = 0;
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    return add_len;
+}
+
+int     Str::append_hex_from(int idx, unsigned long long v)
+{
+    int add_len = 1;
+    for (unsigned long long n = v >> 4; n != 0; n >>= 4)
+        add_len++;
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    char* p = Data + idx + add_len;
+    *p = 0;
+    do
+    {
+        *--p = "0123456789abcdef"[v & 0x0F];
+        v >>= 4;
+    } while (v != 0);
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    return add_len;
+}
+
+// Fast path for "%.*f": scale to an integer and round, which is exact unless we are within rounding error of a .5 tie.
+// Ties, large values, high precisions, NaN and infinities are passed to vsnprintf() so output always match printf().
+int     Str::append_float_from(int idx, double v, int precision)
+{
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+    STR_ASSERT(precision >= 0);
+    if (precision < (int)(sizeof(pow10) / sizeof(pow10[0])))
+    {
+        double scaled = fabs(v) * pow10[precision];
+        if (scaled < 9007199254740992.0) // 2^53, also false for NaN
+        {
+            double scaled_floor = floor(scaled);
+            double frac = scaled - scaled_floor;
+            if (fabs(frac - 0.5) > scaled * 2.3e-16 + 1e-300)
+            {
+                unsigned long long rounded = (unsigned long long)scaled_floor + (frac > 0.5 ? 1 : 0);
+                unsigned long long int_part = rounded / (unsigned long long)pow10[precision];
+                unsigned long long frac_part = rounded % (unsigned long long)pow10[precision];
+                bool neg = signbit(v) != 0;
+                int int_len = StrCountDigits10(int_part);
+                int add_len = (neg ? 1 : 0) + int_len + (precision > 0 ? precision + 1 : 0);
+                if (!cur_owned() || cur_capacity() < idx + add_len)
+                    reserve(idx + add_len);
+                char* p = Data + idx;
+                if (neg)
+                    *p++ = '-';
+                StrWriteDigits10(p + int_len, int_part);
+                if (precision > 0)
+                {
+                    p += int_len;
+                    *p = '.';
+                    for (char* d = p + precision; d > p; d--, frac_part /= 10)
+                        *d = (char)('0' + frac_part % 10);
+                }
+                Data[idx + add_len] = 0;
+                STR_ASSERT(cur_owned());
+                set_length(idx + add_len);
+                return add_len;
+            }
+        }
+    }
+    return appendf_from(idx, "%.*f", precision, v);
+}
+
+int     Str::append_int(long long v)
+{
+    return append_int_from(length(), v);
+}
+
+int     Str::append_uint(unsigned long long v)
+{
+    return append_uint_from(length(), v);
+}
+
+int     Str::append_hex(unsigned long long v)
+{
+    return append_hex_from(length(), v);
+}
+
+int     Str::append_float(double v, int precision)
+{
+    return append_float_from(length(), v, precision);
+}
+
+
+//-------------------------------------------------------------------------
+// Type-safe formatting
+//-------------------------------------------------------------------------
+
+enum StrFmtSpec
+{
+    StrFmtSpec_Default,
+    StrFmtSpec_Hex,
+    StrFmtSpec_Precision
+};
+
+// Parse placeholder starting after '{', return pointer after '}'
+static const char* StrFmtParseSpec(const char* p, StrFmtSpec* out_spec, int* out_precision)
+{
+    *out_spec = StrFmtSpec_Default;
+    *out_precision = 6;
+    if (p[0] == ':' && p[1] == 'x')
+    {
+        *out_spec = StrFmtSpec_Hex;
+        p += 2;
+    }
+    else if (p[0] == ':' && p[1] == '.' && p[2] >= '0' && p[2] <= '9')
+    {
+        *out_spec = StrFmtSpec_Precision;
+        *out_precision = 0;
+        for (p += 2; *p >= '0' && *p <= '9'; p++)
+            *out_precision = *out_precision * 10 + (*p - '0');
+    }
+    STR_ASSERT(*p == '}' && "Invalid format string");
+    return *p == '}' ? p + 1 : p;
+}
+
+// Upper bound of formatted length (exact for everything but floats), so the write pass never has to grow the buffer
+static int StrFmtArgMaxLength(const StrFmtArg& arg, StrFmtSpec spec, int precision)
+{
+    switch (arg.Type)
+    {
+    case StrFmtArg::ArgType_Int:
+    case StrFmtArg::ArgType_Int32:
+        if (spec == StrFmtSpec_Hex)
+            return 16;
+        return arg.Int < 0 ? 1 + StrCountDigits10(0ULL - (unsigned long long)arg.Int) : StrCountDigits10((unsigned long long)arg.Int);
+    case StrFmtArg::ArgType_Uint:
+        return spec == StrFmtSpec_Hex ? 16 : StrCountDigits10(arg.Uint);
+    case StrFmtArg::ArgType_Float:
+    {
+        // Sign + integer digits (+1 for rounding carry) + '.' + decimals
+        double abs_v = fabs(arg.Float);
+        int int_len;
+        if (abs_v < 1e18)
+            int_len = StrCountDigits10((unsigned long long)abs_v) + 1;
+        else if (abs_v <= 1.7976931348623157e308)
+            int_len = (int)log10(abs_v) + 2;
+        else
+            int_len = 3; // "inf", "nan"
+        return 1 + int_len + 1 + precision;
+    }
+    case StrFmtArg::ArgType_Char:
+        return 1;
+    case StrFmtArg::ArgType_String:
+        return (int)(arg.StrEnd - arg.StrBegin);
+    case StrFmtArg::ArgType_Pointer:
+        return 2 + (int)sizeof(void*) * 2;
+    case StrFmtArg::ArgType_None:
+        break;
+    }
+    return 0;
+}
+
+int     Str::fmt_appendv_from(int idx, const char* fmt, const StrFmtArg* args, int args_count)
+{
+    // Pass 1: measure and reserve once
+    int max_len = 0;
+    int arg_n = 0;
+    for (const char* p = fmt; *p; )
+    {
+        if ((p[0] == '{' || p[0] == '}') && p[1] == p[0])
+        {
+            max_len++;
+            p += 2;
+        }
+        else if (p[0] == '{')
+        {
+            StrFmtSpec spec;
+            int precision;
+            p = StrFmtParseSpec(p + 1, &spec, &precision);
+            STR_ASSERT(arg_n < args_count && "Not enough arguments for format string");
+            if (arg_n < args_count)
+                max_len += StrFmtArgMaxLength(args[arg_n++], spec, precision);
+        }
+        else
+        {
+            max_len++;
+            p++;
+        }
+    }
+    STR_ASSERT(arg_n == args_count && "Too many arguments for format string");
+
+    // Format or string arguments pointing into our own buffer would be invalidated by reserve() or overwritten while writing
+    const char* buf_begin = Data;
+    const char* buf_end = Data + cur_capacity() + 1;
+    bool aliased = fmt >= buf_begin && fmt < buf_end;
+    for (int n = 0; n < args_count; n++)
+        if (args[n].Type == StrFmtArg::ArgType_String)
+            aliased |= args[n].StrBegin >= buf_begin && args[n].StrBegin < buf_end;
+    if (aliased)
+    {
+        Str tmp;
+        tmp.reserve(idx + max_len);
+        memcpy(tmp.Data, Data, (size_t)idx);
+        int add_len = tmp.fmt_appendv_from(idx, fmt, args, args_count);
+        set(tmp.c_str(), tmp.c_str() + idx + add_len);
+        return add_len;
+    }
+
+    if (!cur_owned() || cur_capacity() < idx + max_len)
+        reserve(idx + max_len);
+
+    // Pass 2: write
+    int pos = idx;
+    arg_n = 0;
+    for (const char* p = fmt; *p; )
+    {
+        if ((p[0] == '{' || p[0] == '}') && p[1] == p[0])
+        {
+            Data[pos++] = p[0];
+            p += 2;
+            continue;
+        }
+        if (p[0] != '{')
+        {
+            // Copy literal run
+            const char* run_end = p + 1;
+            while (*run_end && *run_end != '{' && *run_end != '}')
+                run_end++;
+            memcpy(Data + pos, p, (size_t)(run_end - p));
+            pos += (int)(run_end - p);
+            p = run_end;
+            continue;
+        }
+        StrFmtSpec spec;
+        int precision;
+        p = StrFmtParseSpec(p + 1, &spec, &precision);
+        if (arg_n >= args_count)
+            continue;
+        const StrFmtArg& arg = args[arg_n++];
+        switch (arg.Type)
+        {
+        case StrFmtArg::ArgType_Int:
+            pos += (spec == StrFmtSpec_Hex) ? append_hex_from(pos, (unsigned long long)arg.Int) : append_int_from(pos, arg.Int);
+            break;
+        case StrFmtArg::ArgType_Int32:
+            pos += (spec == StrFmtSpec_Hex) ? append_hex_from(pos, (unsigned int)arg.Int) : append_int_from(pos, arg.Int);
+            break;
+        case StrFmtArg::ArgType_Uint:
+            pos += (spec == StrFmtSpec_Hex) ? append_hex_from(pos, arg.Uint) : append_uint_from(pos, arg.Uint);
+            break;
+        case StrFmtArg::ArgType_Float:
+            pos += append_float_from(pos, arg.Float, precision);
+            break;
+        case StrFmtArg::ArgType_Char:
+            Data[pos++] = arg.Char;
+            break;
+        case StrFmtArg::ArgType_String:
+            memcpy(Data + pos, arg.StrBegin, (size_t)(arg.StrEnd - arg.StrBegin));
+            pos += (int)(arg.StrEnd - arg.StrBegin);
+            break;
+        case StrFmtArg::ArgType_Pointer:
+            Data[pos++] = '0';
+            Data[pos++] = 'x';
+            pos += append_hex_from(pos, (unsigned long long)(size_t)arg.Pointer);
+            break;
+        case StrFmtArg::ArgType_None:
+            break;
+        }
+    }
+    Data[pos] = 0;
+    STR_ASSERT(cur_owned());
+    set_length(pos);
+    return pos - idx;
+}
+
+
+//-------------------------------------------------------------------------
+// Pool allocator (STR_USE_POOL_ALLOCATOR)
+//-------------------------------------------------------------------------
+
+#if STR_USE_POOL_ALLOCATOR
+
+#include <atomic>
+
+#define STR_POOL_CLASS_COUNT        8           // 32, 64, 128, 256, 512, 1024, 2048, 4096
+#define STR_POOL_CLASS_MIN_SHIFT    5
+#define STR_POOL_HEADER_SIZE        16          // Preserve malloc() alignment
+#define STR_POOL_LARGE_CLASS        (-1)
+#define STR_POOL_STATS_FLUSH_EVERY  256
+
+// Stored right before each block, freed blocks use their payload to store the free list link
+struct StrPoolBlockHeader
+{
+    int     SizeClass;
+};
+
+// Trivially destructible so it stays usable when Str instances are destroyed after thread-local destructors have run (e.g. globals on main thread).
+struct StrPoolThreadCache
+{
+    void*   FreeList[STR_POOL_CLASS_COUNT];
+    int     FreeCount[STR_POOL_CLASS_COUNT];
+    bool    Registered;
+    bool    Exited;
+    int     PendingOps;
+    unsigned long long Stats[5];                // Same order as StrPoolStats
+};
+
+static thread_local StrPoolThreadCache  GStrPoolCache;
+static std::atomic<unsigned long long>  GStrPoolStats[5];
+
+static void StrPoolFlushStats(StrPoolThreadCache* cache)
+{
+    for (int n = 0; n < 5; n++)
+    {
+        if (cache->Stats[n])
+            GStrPoolStats[n].fetch_add(cache->Stats[n], std::memory_order_relaxed);
+        cache->Stats[n] = 0;
+    }
+    cache->PendingOps = 0;
+}
+
+struct StrPoolThreadExit
+{
+    ~StrPoolThreadExit()
+    {
+        StrPoolThreadCache* cache = &GStrPoolCache;
+        for (int class_n = 0; class_n < STR_POOL_CLASS_COUNT; class_n++)
+        {
+            while (void* block = cache->FreeList[class_n])
+            {
+                cache->FreeList[class_n] = *(void**)block;
+                free((char*)block - STR_POOL_HEADER_SIZE);
+            }
+            cache->FreeCount[class_n] = 0;
+        }
+        StrPoolFlushStats(cache);
+        cache->Exited = true;                   // Later frees on this thread go straight to free()
+    }
+};
+
+static inline void StrPoolCount(StrPoolThreadCache* cache, int stat_n)
+{
+    cache->Stats[stat_n]++;
+    if (++cache->PendingOps >= STR_POOL_STATS_FLUSH_EVERY)
+        StrPoolFlushStats(cache);
+}
+
+static inline int StrPoolGetSizeClass(size_t size)
+{
+    if (size > ((size_t)1 << (STR_POOL_CLASS_MIN_SHIFT + STR_POOL_CLASS_COUNT - 1)))
+        return STR_POOL_LARGE_CLASS;
+    int class_n = 0;
+    while (size > ((size_t)1 << (STR_POOL_CLASS_MIN_SHIFT + class_n)))
+        class_n++;
+    return class_n;
+}
+
+void*   StrPoolAlloc(size_t size)
+{
+    StrPoolThreadCache* cache = &GStrPoolCache;
+    int class_n = StrPoolGetSizeClass(size);
+    if (class_n != STR_POOL_LARGE_CLASS)
+    {
+        if (void* block = cache->FreeList[class_n])
+        {
+            cache->FreeList[class_n] = *(void**)block;
+            cache->FreeCount[class_n]--;
+            StrPoolCount(cache, 0);
+            return block;
+        }
+        size = (size_t)1 << (STR_POOL_CLASS_MIN_SHIFT + class_n);
+    }
+    StrPoolCount(cache, class_n == STR_POOL_LARGE_CLASS ? 2 : 1);
+    char* p = (char*)malloc(STR_POOL_HEADER_SIZE + size);
+    if (p == NULL)
+        return NULL;
+    ((StrPoolBlockHeader*)p)->SizeClass = class_n;
+    return p + STR_POOL_HEADER_SIZE;
+}
+
+void    StrPoolFree(void* ptr)
+{
+    if (ptr == NULL)
+        return;
+    StrPoolThreadCache* cache = &GStrPoolCache;
+    int class_n = ((StrPoolBlockHeader*)((char*)ptr - STR_POOL_HEADER_SIZE))->SizeClass;
+    if (class_n != STR_POOL_LARGE_CLASS && !cache->Exited)
+    {
+        int max_count = STR_POOL_CACHE_BYTES >> (STR_POOL_CLASS_MIN_SHIFT + class_n);
+        if (cache->FreeCount[class_n] < max_count)
+        {
+            if (!cache->Registered)
+            {
+                // Register destructor to release cached blocks on thread exit
+                static thread_local StrPoolThreadExit thread_exit;
+                (void)thread_exit;
+                cache->Registered = true;
+            }
+            *(void**)ptr = cache->FreeList[class_n];
+            cache->FreeList[class_n] = ptr;
+            cache->FreeCount[class_n]++;
+            StrPoolCount(cache, 3);
+            return;
+        }
+    }
+    if (!cache->Exited)
+        StrPoolCount(cache, 4);
+    else
+        GStrPoolStats[4].fetch_add(1, std::memory_order_relaxed);
+    free((char*)ptr - STR_POOL_HEADER_SIZE);
+}
+
+void*   StrPoolRealloc(void* ptr, size_t size)
+{
+    if (ptr == NULL)
+        return StrPoolAlloc(size);
+    int class_n = ((StrPoolBlockHeader*)((char*)ptr - STR_POOL_HEADER_SIZE))->SizeClass;
+    int new_class_n = StrPoolGetSizeClass(size);
+    if (class_n != STR_POOL_LARGE_CLASS && new_class_n == class_n)
+        return ptr;
+    if (class_n == STR_POOL_LARGE_CLASS && new_class_n == STR_POOL_LARGE_CLASS)
+    {
+        StrPoolCount(&GStrPoolCache, 2);
+        char* p = (char*)realloc((char*)ptr - STR_POOL_HEADER_SIZE, STR_POOL_HEADER_SIZE + size);
+        return p ? p + STR_POOL_HEADER_SIZE : NULL;
+    }
+
+    // Crossing size classes: copy the smaller of both block sizes
+    size_t old_size = (class_n == STR_POOL_LARGE_CLASS) ? size : (size_t)1 << (STR_POOL_CLASS_MIN_SHIFT + class_n);
+    void* new_ptr = StrPoolAlloc(size);
+    if (new_ptr == NULL)
+        return NULL;
+    memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+    StrPoolFree(ptr);
+    return new_ptr;
+}
+
+void    StrPoolGetStats(StrPoolStats* out_stats)
+{
+    if (!GStrPoolCache.Exited)
+        StrPoolFlushStats(&GStrPoolCache);
+    out_stats->Hits = GStrPoolStats[0].load(std::memory_order_relaxed);
+    out_stats->Misses = GStrPoolStats[1].load(std::memory_order_relaxed);
+    out_stats->LargeAllocs = GStrPoolStats[2].load(std::memory_order_relaxed);
+    out_stats->Frees = GStrPoolStats[3].load(std::memory_order_relaxed);
+    out_stats->Releases = GStrPoolStats[4].load(std::memory_order_relaxed);
+}
+
+#endif // #if STR_USE_POOL_ALLOCATOR
+
+
+//-------------------------------------------------------------------------
+// Hashing
+//-------------------------------------------------------------------------
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>     // for _umul128
+#endif
+
+// 64x64->128 bits multiply, return low and high halves in a and b
+static inline void StrHashMum(unsigned long long* a, unsigned long long* b)
+{
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128; // __extension__ silences -Wpedantic
+    uint128 r = (uint128)*a * *b;
+    *a = (unsigned long long)r;
+    *b = (unsigned long long)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    unsigned long long ha = *a >> 32, hb = *b >> 32, la = (unsigned int)*a, lb = (unsigned int)*b;
+    unsigned long long rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+    unsigned long long lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline unsigned long long StrHashMix(unsigned long long a, unsigned long long b)    { StrHashMum(&a, &b); return a ^ b; }
+static inline unsigned long long StrHashRead8(const unsigned char* p)                       { unsigned long long v; memcpy(&v, p, 8); return v; }
+static inline unsigned long long StrHashRead4(const unsigned char* p)                       { unsigned int v; memcpy(&v, p, 4); return v; }
+static inline unsigned long long StrHashRead3(const unsigned char* p, size_t k)             { return ((unsigned long long)p[0] << 16) | ((unsigned long long)p[k >> 1] << 8) | p[k - 1]; }
+
+// Based on wyhash (public domain, Wang Yi): 64x64->128 multiply-mix, consuming 48 bytes per iteration in three independent lanes
+unsigned long long StrHash(const char* s, const char* s_end, unsigned long long seed)
+{
+    static const unsigned long long secret[4] = { 0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL };
+    if (s_end == NULL)
+        s_end = s + strlen(s);
+    const unsigned char* p = (const unsigned char*)s;
+    size_t len = (size_t)(s_end - s);
+    seed ^= StrHashMix(seed ^ secret[0], secret[1]);
+    unsigned long long a, b;
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (StrHashRead4(p) << 32) | StrHashRead4(p + ((len >> 3) << 2));
+            b = (StrHashRead4(p + len - 4) << 32) | StrHashRead4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0)
+        {
+            a = StrHashRead3(p, len);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            unsigned long long see1 = seed, see2 = seed;
+            do
+            {
+                seed = StrHashMix(StrHashRead8(p) ^ secret[1], StrHashRead8(p + 8) ^ seed);
+                see1 = StrHashMix(StrHashRead8(p + 16) ^ secret[2], StrHashRead8(p + 24) ^ see1);
+                see2 = StrHashMix(StrHashRead8(p + 32) ^ secret[3], StrHashRead8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = StrHashMix(StrHashRead8(p) ^ secret[1], StrHashRead8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = StrHashRead8(p + i - 16);
+        b = StrHashRead8(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    StrHashMum(&a, &b);
+    return StrHashMix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+
+//-------------------------------------------------------------------------
+// String interning
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_INTERNER
+
+#include <mutex>
+
+#define STR_INTERNER_SHARD_BITS     4
+#define STR_INTERNER_SHARD_COUNT    (1 << STR_INTERNER_SHARD_BITS)
+#define STR_INTERNER_BLOCK_SIZE     (64 * 1024)
+
+struct StrInternerEntry
+{
+    const char*         Ptr;                    // NULL for empty slot
+    unsigned long long  Hash;
+    int                 Len;
+    int                 Id;
+};
+
+// Arena blocks are chained through their first bytes
+struct StrInternerShard
+{
+    mutable std::mutex  Mutex;
+    StrInternerEntry*   Entries = NULL;
+    int                 EntriesCapacity = 0;    // Power of two
+    int                 EntriesCount = 0;
+    char*               Block = NULL;           // Current arena block, previous blocks are linked from it
+    size_t              BlockUsed = 0;
+    size_t              BlockSize = 0;
+    size_t              ArenaBytes = 0;
+
+    ~StrInternerShard()
+    {
+        STR_MEMFREE(Entries);
+        while (Block)
+        {
+            char* prev = *(char**)Block;
+            STR_MEMFREE(Block);
+            Block = prev;
+        }
+    }
+
+    const StrInternerEntry* Find(const char* s, int len, unsigned long long hash) const
+    {
+        if (EntriesCapacity == 0)
+            return NULL;
+        int mask = EntriesCapacity - 1;
+        for (int n = (int)(hash & (unsigned long long)mask); Entries[n].Ptr != NULL; n = (n + 1) & mask)
+            if (Entries[n].Hash == hash && Entries[n].Len == len && memcmp(Entries[n].Ptr, s, (size_t)len) == 0)
+                return &Entries[n];
+        return NULL;
+    }
+
+    char* AllocString(const char* s, int len)
+    {
+        size_t size = (size_t)len + 1;
+        if (Block == NULL || BlockUsed + size > BlockSize)
+        {
+            // Large strings get their own block, we keep filling the current one if it exists
+            size_t new_block_size = sizeof(char*) + (size > STR_INTERNER_BLOCK_SIZE / 4 ? size : STR_INTERNER_BLOCK_SIZE);
+            char* new_block = (char*)STR_MEMALLOC(new_block_size);
+            ArenaBytes += new_block_size;
+            if (Block != NULL && size > STR_INTERNER_BLOCK_SIZE / 4)
+            {
+                // Insert behind current block
+                *(char**)new_block = *(char**)Block;
+                *(char**)Block = new_block;
+                memcpy(new_block + sizeof(char*), s, (size_t)len);
+                new_block[sizeof(char*) + len] = 0;
+                return new_block + sizeof(char*);
+            }
+            *(char**)new_block = Block;
+            Block = new_block;
+            BlockUsed = sizeof(char*);
+            BlockSize = new_block_size;
+        }
+        char* dst = Block + BlockUsed;
+        BlockUsed += size;
+        memcpy(dst, s, (size_t)len);
+        dst[len] = 0;
+        return dst;
+    }
+
+    void GrowEntries()
+    {
+        int new_capacity = EntriesCapacity ? EntriesCapacity * 2 : 64;
+        StrInternerEntry* new_entries = (StrInternerEntry*)STR_MEMALLOC((size_t)new_capacity * sizeof(StrInternerEntry));
+        memset(new_entries, 0, (size_t)new_capacity * sizeof(StrInternerEntry));
+        for (int n = 0; n < EntriesCapacity; n++)
+        {
+            if (Entries[n].Ptr == NULL)
+                continue;
+            int dst_n = (int)(Entries[n].Hash & (unsigned long long)(new_capacity - 1));
+            while (new_entries[dst_n].Ptr != NULL)
+                dst_n = (dst_n + 1) & (new_capacity - 1);
+            new_entries[dst_n] = Entries[n];
+        }
+        STR_MEMFREE(Entries);
+        Entries = new_entries;
+        EntriesCapacity = new_capacity;
+    }
+};
+
+StrInterner::StrInterner()
+{
+    Shards = new StrInternerShard[STR_INTERNER_SHARD_COUNT];
+}
+
+StrInterner::~StrInterner()
+{
+    delete[] Shards;
+}
+
+static inline StrInternerShard* StrInternerGetShard(StrInternerShard* shards, unsigned long long hash)
+{
+    return &shards[hash >> (64 - STR_INTERNER_SHARD_BITS)];
+}
+
+StrInterned StrInterner::intern(const char* s, const char* s_end)
+{
+    if (s_end == NULL)
+        s_end = s + strlen(s);
+    int len = (int)(s_end - s);
+    unsigned long long hash = StrHash(s, s_end);
+    StrInternerShard* shard = StrInternerGetShard(Shards, hash);
+    std::lock_guard<std::mutex> lock(shard->Mutex);
+    if (const StrInternerEntry* entry = shard->Find(s, len, hash))
+        return StrInterned(entry->Ptr, entry->Hash, entry->Id);
+
+    if ((shard->EntriesCount + 1) * 4 > shard->EntriesCapacity * 3)
+        shard->GrowEntries();
+    int mask = shard->EntriesCapacity - 1;
+    int n = (int)(hash & (unsigned long long)mask);
+    while (shard->Entries[n].Ptr != NULL)
+        n = (n + 1) & mask;
+    StrInternerEntry* entry = &shard->Entries[n];
+    entry->Ptr = shard->AllocString(s, len);
+    entry->Hash = hash;
+    entry->Len = len;
+    entry->Id = (shard->EntriesCount << STR_INTERNER_SHARD_BITS) | (int)(shard - Shards);
+    shard->EntriesCount++;
+    return StrInterned(entry->Ptr, entry->Hash, entry->Id);
+}
+
+bool    StrInterner::find(const char* s, const char* s_end, StrInterned* out) const
+{
+    if (s_end == NULL)
+        s_end = s + strlen(s);
+    unsigned long long hash = StrHash(s, s_end);
+    StrInternerShard* shard = StrInternerGetShard(Shards, hash);
+    std::lock_guard<std::mutex> lock(shard->Mutex);
+    const StrInternerEntry* entry = shard->Find(s, (int)(s_end - s), hash);
+    if (entry == NULL)
+        return false;
+    if (out)
+        *out = StrInterned(entry->Ptr, entry->Hash, entry->Id);
+    return true;
+}
+
+int     StrInterner::size() const
+{
+    int count = 0;
+    for (int n = 0; n < STR_INTERNER_SHARD_COUNT; n++)
+    {
+        std::lock_guard<std::mutex> lock(Shards[n].Mutex);
+        count += Shards[n].EntriesCount;
+    }
+    return count;
+}
+
+size_t  StrInterner::memory_usage() const
+{
+    size_t bytes = sizeof(StrInternerShard) * STR_INTERNER_SHARD_COUNT;
+    for (int n = 0; n < STR_INTERNER_SHARD_COUNT; n++)
+    {
+        std::lock_guard<std::mutex> lock(Shards[n].Mutex);
+        bytes += Shards[n].ArenaBytes + (size_t)Shards[n].EntriesCapacity * sizeof(StrInternerEntry);
+    }
+    return bytes;
+}
+
+#endif // #if STR_ENABLE_INTERNER
+
+//-------------------------------------------------------------------------
+// Shared buffers
+//-------------------------------------------------------------------------
+
+#include <atomic>
+
+// Stored right before the string data of a shared buffer
+struct StrSharedHeader
+{
+    std::atomic<int>    RefCount;
+    void*               MappedBase;             // With map_file(): start of the mapping (or heap block), else NULL
+    size_t              MappedSize;
+};
+
+#if STR_ENABLE_FILES
+static void StrUnmapFile(void* base, size_t size);
+#endif
+
+static inline StrSharedHeader* StrGetSharedHeader(char* data)
+{
+    return (StrSharedHeader*)(void*)(data - sizeof(StrSharedHeader));
+}
+
+void    Str::make_shared()
+{
+    if (shared())
+        return;
+    int len = length();
+    if (len == 0)
+        return;
+    char* block = (char*)STR_MEMALLOC(sizeof(StrSharedHeader) + (size_t)len + 1);
+    StrSharedHeader* header = new (block) StrSharedHeader();
+    header->RefCount.store(1, std::memory_order_relaxed);
+    header->MappedBase = NULL;
+    header->MappedSize = 0;
+    char* new_data = block + sizeof(StrSharedHeader);
+    memcpy(new_data, Data, (size_t)len + 1);
+    free_data();
+    Data = new_data;
+    Capacity = len;
+    Owned = 0;
+    set_length(len);
+}
+
+void    Str::shared_retain()
+{
+    STR_ASSERT(shared());
+    StrGetSharedHeader(Data)->RefCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void    Str::shared_release()
+{
+    STR_ASSERT(shared());
+    shared_release(Data);
+}
+
+void    Str::shared_release(char* data)
+{
+    StrSharedHeader* header = StrGetSharedHeader(data);
+    if (header->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        // Read the mapping before destroying the header
+        void* mapped_base = header->MappedBase;
+        size_t mapped_size = header->MappedSize;
+        header->~StrSharedHeader();
+#if STR_ENABLE_FILES
+        if (mapped_base)
+        {
+            StrUnmapFile(mapped_base, mapped_size);
+            return;
+        }
+#else
+        (void)mapped_base;
+        (void)mapped_size;
+#endif
+        STR_MEMFREE(header);
+    }
+}
+
+
+//-------------------------------------------------------------------------
+// Search
+//-------------------------------------------------------------------------
+
+#if STR_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+static inline int StrCountTrailingZeros(unsigned int mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline int StrCountTrailingZeros64(unsigned long long mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned int lo = (unsigned int)mask;
+    return lo ? StrCountTrailingZeros(lo) : 32 + StrCountTrailingZeros((unsigned int)(mask >> 32));
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+static inline int StrHighestBitIndex(unsigned int mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return (int)index;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+static inline int StrPopCount(unsigned int mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    mask = mask - ((mask >> 1) & 0x55555555);
+    mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+    return (int)((((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+#else
+    return __builtin_popcount(mask);
+#endif
+}
+
+// Find 'needle' in [haystack, haystack+haystack_len). Needle is not empty.
+static const char* StrFindSubstr(const char* haystack, int haystack_len, const char* needle, int needle_len)
+{
+    if (needle_len == 1)
+        return (const char*)memchr(haystack, needle[0], (size_t)haystack_len);
+    if (needle_len > haystack_len)
+        return NULL;
+
+    int i = 0;
+    const int last_pos = haystack_len - needle_len; // Last valid start position
+#if STR_USE_SSE2
+    // Compare first and last byte of needle for 16 positions at a time, verify candidates with memcmp().
+    // Main loop checks 64 positions per iteration and only extracts the mask when any candidate was found.
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    for (; i + 63 <= last_pos; i += 64)
+    {
+        const char* p = haystack + i;
+        __m128i eq[4];
+        for (int n = 0; n < 4; n++)
+            eq[n] = _mm_and_si128(_mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i*)(const void*)(p + n * 16))), _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i*)(const void*)(p + n * 16 + needle_len - 1))));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(eq[0], eq[1]), _mm_or_si128(eq[2], eq[3]))) == 0)
+            continue;
+        unsigned long long mask = 0;
+        for (int n = 0; n < 4; n++)
+            mask |= (unsigned long long)(unsigned int)_mm_movemask_epi8(eq[n]) << (n * 16);
+        while (mask != 0)
+        {
+            int bit = StrCountTrailingZeros64(mask);
+            if (memcmp(p + bit + 1, needle + 1, (size_t)needle_len - 2) == 0)
+                return p + bit;
+            mask &= mask - 1;
+        }
+    }
+    for (; i + 15 <= last_pos; i += 16)
+    {
+        const __m128i block_first = _mm_loadu_si128((const __m128i*)(const void*)(haystack + i));
+        const __m128i block_last = _mm_loadu_si128((const __m128i*)(const void*)(haystack + i + needle_len - 1));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0)
+        {
+            int bit = StrCountTrailingZeros(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, (size_t)needle_len - 2) == 0)
+                return haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last_pos; i++)
+    {
+        const char* p = (const char*)memchr(haystack + i, needle[0], (size_t)(last_pos - i + 1));
+        if (p == NULL)
+            return NULL;
+        i = (int)(p - haystack);
+        if (memcmp(p + 1, needle + 1, (size_t)needle_len - 1) == 0)
+            return p;
+    }
+    return NULL;
+}
+
+// Find last 'c' in [haystack, haystack+haystack_len). memrchr() isn't portable (needs _GNU_SOURCE before the first include of <string.h>).
+static const char* StrFindLastChar(const char* haystack, int haystack_len, char c)
+{
+    int i = haystack_len;
+#if STR_USE_SSE2
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; i >= 16; i -= 16)
+    {
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(needle, _mm_loadu_si128((const __m128i*)(const void*)(haystack + i - 16))));
+        if (mask != 0)
+            return haystack + i - 16 + StrHighestBitIndex(mask);
+    }
+#endif
+    while (i > 0)
+        if (haystack[--i] == c)
+            return haystack + i;
+    return NULL;
+}
+
+// Find last 'needle' in [haystack, haystack+haystack_len). Needle is not empty. Same first and last byte filter as StrFindSubstr(), scanning backward.
+static const char* StrFindLastSubstr(const char* haystack, int haystack_len, const char* needle, int needle_len)
+{
+    if (needle_len == 1)
+        return StrFindLastChar(haystack, haystack_len, needle[0]);
+    if (needle_len > haystack_len)
+        return NULL;
+
+    int i = haystack_len - needle_len + 1; // Positions [0, i) are left to check
+#if STR_USE_SSE2
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    for (; i >= 16; i -= 16)
+    {
+        const char* p = haystack + i - 16;
+        const __m128i block_first = _mm_loadu_si128((const __m128i*)(const void*)p);
+        const __m128i block_last = _mm_loadu_si128((const __m128i*)(const void*)(p + needle_len - 1));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0)
+        {
+            int bit = StrHighestBitIndex(mask);
+            if (memcmp(p + bit + 1, needle + 1, (size_t)needle_len - 2) == 0)
+                return p + bit;
+            mask &= ~(1u << bit);
+        }
+    }
+#endif
+    while (i > 0)
+    {
+        i--;
+        if (haystack[i] == needle[0] && memcmp(haystack + i + 1, needle + 1, (size_t)needle_len - 1) == 0)
+            return haystack + i;
+    }
+    return NULL;
+}
+
+int     Str::find(char c, int from) const
+{
+    STR_ASSERT(from >= 0 && from <= length());
+    const char* p = (const char*)memchr(Data + from, c, (size_t)(length() - from));
+    return p ? (int)(p - Data) : -1;
+}
+
+int     Str::find(const char* needle, int from) const
+{
+    int len = length();
+    STR_ASSERT(from >= 0 && from <= len);
+    int needle_len = (int)strlen(needle);
+    if (needle_len == 0)
+        return from;
+    const char* p = StrFindSubstr(Data + from, len - from, needle, needle_len);
+    return p ? (int)(p - Data) : -1;
+}
+
+int     Str::rfind(char c) const
+{
+    const char* p = StrFindLastChar(Data, length(), c);
+    return p ? (int)(p - Data) : -1;
+}
+
+int     Str::rfind(const char* needle) const
+{
+    int len = length();
+    int needle_len = (int)strlen(needle);
+    if (needle_len == 0)
+        return len;
+    const char* p = StrFindLastSubstr(Data, len, needle, needle_len);
+    return p ? (int)(p - Data) : -1;
+}
+
+int     Str::find_first_of(const char* charset, int from) const
+{
+    int len = length();
+    STR_ASSERT(from >= 0 && from <= len);
+    int charset_len = (int)strlen(charset);
+    if (charset_len == 0)
+        return -1;
+    if (charset_len == 1)
+        return find(charset[0], from);
+
+    int i = from;
+#if STR_USE_SSE2
+    // Small sets: compare 16 bytes against each character of the set
+    if (charset_len <= 4)
+    {
+        __m128i set[4];
+        for (int n = 0; n < 4; n++)
+            set[n] = _mm_set1_epi8(charset[n < charset_len ? n : 0]);
+        for (; i + 16 <= len; i += 16)
+        {
+            const __m128i block = _mm_loadu_si128((const __m128i*)(const void*)(Data + i));
+            __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, set[0]), _mm_cmpeq_epi8(block, set[1])), _mm_or_si128(_mm_cmpeq_epi8(block, set[2]), _mm_cmpeq_epi8(block, set[3])));
+            if (unsigned int mask = (unsigned int)_mm_movemask_epi8(eq))
+                return i + StrCountTrailingZeros(mask);
+        }
+    }
+#endif
+    // Larger sets: 256-bit bitmap
+    unsigned int bitmap[256 / 32] = { 0 };
+    for (const unsigned char* c = (const unsigned char*)charset; *c; c++)
+        bitmap[*c >> 5] |= 1u << (*c & 31);
+    for (; i < len; i++)
+    {
+        unsigned char c = (unsigned char)Data[i];
+        if (bitmap[c >> 5] & (1u << (c & 31)))
+            return i;
+    }
+    return -1;
+}
+
+int     Str::count(char c) const
+{
+    int len = length();
+    int total = 0;
+    int i = 0;
+#if STR_USE_SSE2
+    const __m128i c_set = _mm_set1_epi8(c);
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128((const __m128i*)(const void*)(Data + i));
+        total += StrPopCount((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, c_set)));
+    }
+#endif
+    for (; i < len; i++)
+        total += (Data[i] == c) ? 1 : 0;
+    return total;
+}
+
+int     Str::count(const char* needle) const
+{
+    int len = length();
+    int needle_len = (int)strlen(needle);
+    if (needle_len == 0)
+        return 0;
+    int total = 0;
+    for (const char* p = Data; (p = StrFindSubstr(p, len - (int)(p - Data), needle, needle_len)) != NULL; p += needle_len)
+        total++;
+    return total;
+}
+
+bool    Str::starts_with(const char* prefix) const
+{
+    for (const char* p = Data; *prefix; p++, prefix++)
+        if (*p != *prefix)
+            return false;
+    return true;
+}
+
+bool    Str::ends_with(const char* suffix) const
+{
+    int len = length();
+    int suffix_len = (int)strlen(suffix);
+    return suffix_len <= len && memcmp(Data + len - suffix_len, suffix, (size_t)suffix_len) == 0;
+}
+
+
+//-------------------------------------------------------------------------
+// Case conversion, UTF-8
+//-------------------------------------------------------------------------
+
+#if STR_USE_SSE2
+// 0xFF for each byte in ['lo', 'lo' + 25], 0 otherwise: adding 128 - 'lo' moves this range to the 26 smallest signed values.
+static inline __m128i StrLetterMask(__m128i v, char lo)
+{
+    return _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8((char)(128 - lo))), _mm_set1_epi8((char)(-128 + 26)));
+}
+#endif
+
+// Flip case of letters in ['lo', 'lo' + 25]
+static void StrFlipCase(char* s, char* s_end, char lo)
+{
+#if STR_USE_SSE2
+    const __m128i flip = _mm_set1_epi8(0x20);
+    for (; s_end - s >= 16; s += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(const void*)s);
+        _mm_storeu_si128((__m128i*)(void*)s, _mm_xor_si128(v, _mm_and_si128(StrLetterMask(v, lo), flip)));
+    }
+#endif
+    for (; s < s_end; s++)
+        if (*s >= lo && *s <= lo + 25)
+            *s ^= 0x20;
+}
+
+void    StrToLower(char* s, char* s_end)
+{
+    StrFlipCase(s, s_end, 'A');
+}
+
+void    StrToUpper(char* s, char* s_end)
+{
+    StrFlipCase(s, s_end, 'a');
+}
+
+bool    StrEqualsIgnoreCase(const char* a, const char* b, int len)
+{
+    int i = 0;
+#if STR_USE_SSE2
+    // Bytes match if equal, or if they only differ by 0x20 and are letters. Check 32 bytes per iteration.
+    const __m128i flip = _mm_set1_epi8(0x20);
+    for (; i + 32 <= len; i += 32)
+    {
+        __m128i ok[2];
+        for (int n = 0; n < 2; n++)
+        {
+            const __m128i va = _mm_loadu_si128((const __m128i*)(const void*)(a + i + n * 16));
+            const __m128i diff = _mm_xor_si128(va, _mm_loadu_si128((const __m128i*)(const void*)(b + i + n * 16)));
+            const __m128i case_diff = _mm_and_si128(_mm_cmpeq_epi8(diff, flip), StrLetterMask(_mm_or_si128(va, flip), 'a'));
+            ok[n] = _mm_or_si128(_mm_cmpeq_epi8(diff, _mm_setzero_si128()), case_diff);
+        }
+        if (_mm_movemask_epi8(_mm_and_si128(ok[0], ok[1])) != 0xFFFF)
+            return false;
+    }
+#endif
+    for (; i < len; i++)
+    {
+        char ca = a[i], cb = b[i];
+        if (ca >= 'A' && ca <= 'Z') ca ^= 0x20;
+        if (cb >= 'A' && cb <= 'Z') cb ^= 0x20;
+        if (ca != cb)
+            return false;
+    }
+    return true;
+}
+
+// Length of the valid multi-byte sequence starting at 'p' (p[0] >= 0x80), or 0 if invalid
+static inline int StrUtf8SequenceLength(const unsigned char* p, const unsigned char* p_end)
+{
+    const unsigned int c = p[0];
+    int len;
+    unsigned int lo = 0x80, hi = 0xBF;  // Range of the second byte
+    if (c >= 0xC2 && c <= 0xDF)         { len = 2; }
+    else if (c >= 0xE0 && c <= 0xEF)    { len = 3; if (c == 0xE0) lo = 0xA0; else if (c == 0xED) hi = 0x9F; }   // Overlong, surrogates
+    else if (c >= 0xF0 && c <= 0xF4)    { len = 4; if (c == 0xF0) lo = 0x90; else if (c == 0xF4) hi = 0x8F; }   // Overlong, > U+10FFFF
+    else                                return 0;
+    if (p_end - p < len || p[1] < lo || p[1] > hi)
+        return 0;
+    for (int n = 2; n < len; n++)
+        if ((p[n] & 0xC0) != 0x80)
+            return 0;
+    return len;
+}
+
+bool    StrIsValidUtf8(const char* s, const char* s_end)
+{
+    // Skip 16 bytes at a time while in ASCII, validate multi-byte sequences one at a time.
+    const unsigned char* p = (const unsigned char*)s;
+    const unsigned char* p_end = (const unsigned char*)s_end;
+    while (p < p_end)
+    {
+#if STR_USE_SSE2
+        if (p_end - p >= 16)
+        {
+            const int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(const void*)p));
+            if (mask == 0)
+            {
+                p += 16;
+                continue;
+            }
+            p += StrCountTrailingZeros((unsigned int)mask);
+        }
+#endif
+        if (*p < 0x80)
+        {
+            p++;
+            continue;
+        }
+        const int seq_len = StrUtf8SequenceLength(p, p_end);
+        if (seq_len == 0)
+            return false;
+        p += seq_len;
+    }
+    return true;
+}
+
+int     StrUtf8Length(const char* s, const char* s_end)
+{
+    int total = 0;
+#if STR_USE_SSE2
+    // Continuation bytes 0x80..0xBF are < -64 as signed bytes. Count others with per-byte counters, summed with _mm_sad_epu8() before they can overflow.
+    const __m128i threshold = _mm_set1_epi8(-65);
+    while (s_end - s >= 16)
+    {
+        __m128i counters = _mm_setzero_si128();
+        for (int n = 0; n < 255 && s_end - s >= 16; n++, s += 16)
+            counters = _mm_sub_epi8(counters, _mm_cmpgt_epi8(_mm_loadu_si128((const __m128i*)(const void*)s), threshold));
+        const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+        total += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+#endif
+    for (; s < s_end; s++)
+        total += ((*s & 0xC0) != 0x80) ? 1 : 0;
+    return total;
+}
+
+void    Str::to_lower()
+{
+    int len = length();
+    if (!cur_owned() && len > 0)
+        reserve_exact(len);
+    StrToLower(Data, Data + len);
+}
+
+void    Str::to_upper()
+{
+    int len = length();
+    if (!cur_owned() && len > 0)
+        reserve_exact(len);
+    StrToUpper(Data, Data + len);
+}
+
+bool    Str::equals_ignore_case(const StrView& rhs) const
+{
+    int len = length();
+    return len == rhs.length() && StrEqualsIgnoreCase(Data, rhs.Begin, len);
+}
+
+
+//-------------------------------------------------------------------------
+// Comparison, sorting
+//-------------------------------------------------------------------------
+
+int     StrCommonPrefixLength(const char* a, const char* b, int len)
+{
+    int i = 0;
+#if STR_USE_SSE2
+    for (; i + 16 <= len; i += 16)
+    {
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(const void*)(a + i)), _mm_loadu_si128((const __m128i*)(const void*)(b + i))));
+        if (mask != 0xFFFF)
+            return i + StrCountTrailingZeros(~mask);
+    }
+#else
+    for (; i + 8 <= len; i += 8)
+    {
+        unsigned long long va, vb;
+        memcpy(&va, a + i, 8);
+        memcpy(&vb, b + i, 8);
+        if (va != vb)
+            break;
+    }
+#endif
+    while (i < len && a[i] == b[i])
+        i++;
+    return i;
+}
+
+int     StrCompare(const char* a, const char* a_end, const char* b, const char* b_end)
+{
+    int a_len = (int)(a_end - a);
+    int b_len = (int)(b_end - b);
+    int len = a_len < b_len ? a_len : b_len;
+    int i = StrCommonPrefixLength(a, b, len);
+    if (i < len)
+        return (int)(unsigned char)a[i] - (int)(unsigned char)b[i];
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+int     Str::compare(const StrView& rhs) const
+{
+    return StrCompare(Data, Data + length(), rhs.Begin, rhs.End);
+}
+
+int     Str::common_prefix_length(const StrView& rhs) const
+{
+    int len = length();
+    return StrCommonPrefixLength(Data, rhs.Begin, len < rhs.length() ? len : rhs.length());
+}
+
+#define STR_SORT_RADIX_THRESHOLD        64      // Smaller buckets use multikey quicksort
+#define STR_SORT_INSERTION_THRESHOLD    12      // Smaller partitions use insertion sort
+
+struct StrSortItem
+{
+    unsigned long long  Key;                    // 8 bytes of the string from the current depth, big-endian so they compare as an integer, zero-padded
+    const char*         Ptr;
+    int                 Len;
+    int                 Index;                  // Position in the input array
+};
+
+static inline unsigned long long StrSortLoadKey(const char* s, int len, int depth)
+{
+    unsigned long long key = 0;
+    int avail = len - depth;
+    if (avail >= 8)
+    {
+        memcpy(&key, s + depth, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return key;
+#elif defined(_MSC_VER) && !defined(__clang__)
+        return _byteswap_uint64(key);
+#else
+        return __builtin_bswap64(key);
+#endif
+    }
+    for (int n = 0; n < avail; n++)
+        key |= (unsigned long long)(unsigned char)s[depth + n] << (56 - n * 8);
+    return key;
+}
+
+// With depth < 0, keys are lengths and nothing else is compared (see StrSortEqualKeys)
+static inline bool StrSortLess(const StrSortItem& a, const StrSortItem& b, int depth)
+{
+    if (a.Key != b.Key || depth < 0)
+        return a.Key < b.Key;
+    int next = depth + 8;
+    if (a.Len <= next && b.Len <= next)
+        return a.Len < b.Len;
+    return StrCompare(a.Ptr + (a.Len < next ? a.Len : next), a.Ptr + a.Len, b.Ptr + (b.Len < next ? b.Len : next), b.Ptr + b.Len) < 0;
+}
+
+static void StrSortByKey(StrSortItem* items, StrSortItem* tmp, int count, int depth);
+
+// All items share their first 'depth + 8' bytes (counting zero padding): load the next 8 bytes, skipping ahead while they are still all equal.
+// Once no item is longer, items can only differ by their length (with embedded zero characters).
+static void StrSortEqualKeys(StrSortItem* items, StrSortItem* tmp, int count, int depth)
+{
+    for (;;)
+    {
+        int next = depth + 8;
+        bool any_longer = false;
+        bool same_len = true;
+        for (int n = 0; n < count; n++)
+        {
+            any_longer |= items[n].Len > next;
+            same_len &= items[n].Len == items[0].Len;
+        }
+        if (!any_longer)
+        {
+            if (!same_len)
+            {
+                for (int n = 0; n < count; n++)
+                    items[n].Key = (unsigned long long)(unsigned int)items[n].Len;
+                StrSortByKey(items, tmp, count, -1);
+            }
+            return;
+        }
+        bool all_equal = true;
+        for (int n = 0; n < count; n++)
+        {
+            items[n].Key = StrSortLoadKey(items[n].Ptr, items[n].Len, next);
+            all_equal &= items[n].Key == items[0].Key;
+        }
+        depth = next;
+        if (!all_equal)
+            break;
+    }
+    StrSortByKey(items, tmp, count, depth);
+}
+
+// MSD radix sort on the byte of the keys at 'shift' and below. Items share the bytes of their keys above 'shift'.
+static void StrSortRadix(StrSortItem* items, StrSortItem* tmp, int count, int depth, int shift)
+{
+    int bucket_sizes[256];
+    for (;;)
+    {
+        memset(bucket_sizes, 0, sizeof(bucket_sizes));
+        for (int n = 0; n < count; n++)
+            bucket_sizes[(items[n].Key >> shift) & 0xFF]++;
+        if (bucket_sizes[(items[0].Key >> shift) & 0xFF] != count)
+            break;
+        // Single bucket: no need to move anything
+        if (shift == 0)
+        {
+            if (depth >= 0)
+                StrSortEqualKeys(items, tmp, count, depth);
+            return;
+        }
+        shift -= 8;
+    }
+
+    int bucket_starts[256];
+    for (int b = 0, pos = 0; b < 256; b++)
+    {
+        bucket_starts[b] = pos;
+        pos += bucket_sizes[b];
+    }
+    for (int n = 0; n < count; n++)
+        tmp[bucket_starts[(items[n].Key >> shift) & 0xFF]++] = items[n];
+    memcpy(items, tmp, sizeof(StrSortItem) * (size_t)count);
+
+    for (int b = 0, pos = 0; b < 256; pos += bucket_sizes[b], b++)
+    {
+        int size = bucket_sizes[b];
+        if (size < 2)
+            continue;
+        if (shift == 0)
+        {
+            if (depth >= 0)
+                StrSortEqualKeys(items + pos, tmp, size, depth);
+        }
+        else if (size > STR_SORT_RADIX_THRESHOLD)
+        {
+            StrSortRadix(items + pos, tmp, size, depth, shift - 8);
+        }
+        else
+        {
+            StrSortByKey(items + pos, tmp, size, depth);
+        }
+    }
+}
+
+// Sort by key, then sort groups of equal keys on the following bytes
+static void StrSortByKey(StrSortItem* items, StrSortItem* tmp, int count, int depth)
+{
+    while (count > 1)
+    {
+        if (count <= STR_SORT_INSERTION_THRESHOLD)
+        {
+            // Complete comparisons, including the following bytes
+            for (int i = 1; i < count; i++)
+            {
+                StrSortItem item = items[i];
+                int j = i;
+                for (; j > 0 && StrSortLess(item, items[j - 1], depth); j--)
+                    items[j] = items[j - 1];
+                items[j] = item;
+            }
+            return;
+        }
+        if (count > STR_SORT_RADIX_THRESHOLD)
+        {
+            StrSortRadix(items, tmp, count, depth, 56);
+            return;
+        }
+
+        // Multikey quicksort: 3-way partition around the median of three keys
+        unsigned long long k0 = items[0].Key, k1 = items[count / 2].Key, k2 = items[count - 1].Key;
+        unsigned long long pivot = (k0 < k1) ? ((k1 < k2) ? k1 : (k0 < k2) ? k2 : k0) : ((k0 < k2) ? k0 : (k1 < k2) ? k2 : k1);
+        int lt = 0, i = 0, gt = count;
+        while (i < gt)
+        {
+            if (items[i].Key < pivot)
+            {
+                StrSortItem t = items[lt]; items[lt++] = items[i]; items[i++] = t;
+            }
+            else if (items[i].Key > pivot)
+            {
+                StrSortItem t = items[--gt]; items[gt] = items[i]; items[i] = t;
+            }
+            else
+            {
+                i++;
+            }
+        }
+        if (depth >= 0 && gt - lt > 1)
+            StrSortEqualKeys(items + lt, tmp, gt - lt, depth);
+        StrSortByKey(items, tmp, lt, depth);
+        items += gt;            // Loop on the last partition
+        count -= gt;
+    }
+}
+
+// Sort items, then move elements in order through the temporary buffer
+template<typename T>
+static void StrSortArray(T* elements, int count)
+{
+    if (count < 2)
+        return;
+    StrSortItem* items = (StrSortItem*)STR_MEMALLOC(sizeof(StrSortItem) * (size_t)count);
+    for (int n = 0; n < count; n++)
+    {
+        StrView s(elements[n]);
+        items[n].Ptr = s.Begin;
+        items[n].Len = s.length();
+        items[n].Key = StrSortLoadKey(s.Begin, items[n].Len, 0);
+        items[n].Index = n;
+    }
+    void* tmp = STR_MEMALLOC((sizeof(T) > sizeof(StrSortItem) ? sizeof(T) : sizeof(StrSortItem)) * (size_t)count);
+    StrSortByKey(items, (StrSortItem*)tmp, count, 0);
+
+    T* sorted = (T*)tmp;
+    for (int n = 0; n < count; n++)
+        new (&sorted[n]) T(static_cast<T&&>(elements[items[n].Index]));
+    for (int n = 0; n < count; n++)
+    {
+        elements[n] = static_cast<T&&>(sorted[n]);
+        sorted[n].~T();
+    }
+    STR_MEMFREE(tmp);
+    STR_MEMFREE(items);
+}
+
+void    StrSort(Str* begin, Str* end)
+{
+    StrSortArray(begin, (int)(end - begin));
+}
+
+void    StrSort(StrRef* begin, StrRef* end)
+{
+    StrSortArray(begin, (int)(end - begin));
+}
+
+void    StrSort(StrView* begin, StrView* end)
+{
+    StrSortArray(begin, (int)(end - begin));
+}
+
+
+//-------------------------------------------------------------------------
+// Escaping, encoding
+//-------------------------------------------------------------------------
+
+static const char StrHexDigitsLower[] = "0123456789abcdef";
+static const char StrHexDigitsUpper[] = "0123456789ABCDEF";
+static const char StrBase64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Length of a character once escaped for JSON
+static inline int StrJsonEscapedLen(unsigned char c)
+{
+    if (c == '"' || c == '\\')
+        return 2;
+    if (c >= 0x20)
+        return 1;
+    return (c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') ? 2 : 6;
+}
+
+static inline bool StrUrlIsUnreserved(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+static inline int StrHexDigitValue(unsigned char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static inline int StrBase64Value(unsigned char c)
+{
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+#if STR_USE_SSE2
+// Bit set for each of the 16 bytes at 'p' that needs escaping
+static inline unsigned int StrJsonSpecialMask16(const char* p)
+{
+    const __m128i v = _mm_loadu_si128((const __m128i*)(const void*)p);
+    const __m128i ctrl = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));   // <= 0x1F unsigned
+    const __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    const __m128i backslash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+    return (unsigned int)_mm_movemask_epi8(_mm_or_si128(ctrl, _mm_or_si128(quote, backslash)));
+}
+
+static inline unsigned int StrUrlSpecialMask16(const char* p)
+{
+    const __m128i v = _mm_loadu_si128((const __m128i*)(const void*)p);
+    const __m128i letter = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    const __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i ok = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(25)), letter);
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit));
+    ok = _mm_or_si128(ok, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')), _mm_cmpeq_epi8(v, _mm_set1_epi8('.'))));
+    ok = _mm_or_si128(ok, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')), _mm_cmpeq_epi8(v, _mm_set1_epi8('~'))));
+    return (unsigned int)_mm_movemask_epi8(ok) ^ 0xFFFF;
+}
+#endif
+
+static const char* StrJsonFindSpecial(const char* p, const char* p_end)
+{
+#if STR_USE_SSE2
+    for (; p + 16 <= p_end; p += 16)
+        if (unsigned int mask = StrJsonSpecialMask16(p))
+            return p + StrCountTrailingZeros(mask);
+#endif
+    while (p < p_end && StrJsonEscapedLen((unsigned char)*p) == 1)
+        p++;
+    return p;
+}
+
+static const char* StrUrlFindSpecial(const char* p, const char* p_end)
+{
+#if STR_USE_SSE2
+    for (; p + 16 <= p_end; p += 16)
+        if (unsigned int mask = StrUrlSpecialMask16(p))
+            return p + StrCountTrailingZeros(mask);
+#endif
+    while (p < p_end && StrUrlIsUnreserved((unsigned char)*p))
+        p++;
+    return p;
+}
+
+int     Str::append_json_escaped_from(int idx, const StrView& src)
+{
+    if (points_into(src.Begin))
+    {
+        Str tmp;
+        tmp.set(src);
+        return append_json_escaped_from(idx, StrView(tmp.c_str(), tmp.c_str() + src.length()));
+    }
+
+    // Measure: only special characters are looked at one by one
+    const char* s = src.Begin;
+    const char* s_end = src.End;
+    int add_len = src.length();
+    const char* p = s;
+#if STR_USE_SSE2
+    for (; p + 16 <= s_end; p += 16)
+        for (unsigned int mask = StrJsonSpecialMask16(p); mask != 0; mask &= mask - 1)
+            add_len += StrJsonEscapedLen((unsigned char)p[StrCountTrailingZeros(mask)]) - 1;
+#endif
+    for (; p < s_end; p++)
+        add_len += StrJsonEscapedLen((unsigned char)*p) - 1;
+
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    char* dst = Data + idx;
+    for (p = s; ; p++)
+    {
+        const char* run_end = StrJsonFindSpecial(p, s_end);
+        if (run_end != p)
+            memcpy(dst, p, (size_t)(run_end - p));
+        dst += run_end - p;
+        p = run_end;
+        if (p == s_end)
+            break;
+        unsigned char c = (unsigned char)*p;
+        *dst++ = '\\';
+        switch (c)
+        {
+        case '"':   *dst++ = '"'; break;
+        case '\\':  *dst++ = '\\'; break;
+        case '\b':  *dst++ = 'b'; break;
+        case '\f':  *dst++ = 'f'; break;
+        case '\n':  *dst++ = 'n'; break;
+        case '\r':  *dst++ = 'r'; break;
+        case '\t':  *dst++ = 't'; break;
+        default:
+            dst[0] = 'u'; dst[1] = '0'; dst[2] = '0';
+            dst[3] = StrHexDigitsLower[c >> 4];
+            dst[4] = StrHexDigitsLower[c & 0x0F];
+            dst += 5;
+            break;
+        }
+    }
+    *dst = 0;
+    STR_ASSERT(dst == Data + idx + add_len);
+    set_length(idx + add_len);
+    return add_len;
+}
+
+int     Str::append_url_encoded_from(int idx, const StrView& src)
+{
+    if (points_into(src.Begin))
+    {
+        Str tmp;
+        tmp.set(src);
+        return append_url_encoded_from(idx, StrView(tmp.c_str(), tmp.c_str() + src.length()));
+    }
+
+    const char* s = src.Begin;
+    const char* s_end = src.End;
+    int special_count = 0;
+    const char* p = s;
+#if STR_USE_SSE2
+    for (; p + 16 <= s_end; p += 16)
+        special_count += StrPopCount(StrUrlSpecialMask16(p));
+#endif
+    for (; p < s_end; p++)
+        special_count += StrUrlIsUnreserved((unsigned char)*p) ? 0 : 1;
+    int add_len = src.length() + special_count * 2;
+
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    char* dst = Data + idx;
+    for (p = s; ; p++)
+    {
+        const char* run_end = StrUrlFindSpecial(p, s_end);
+        if (run_end != p)
+            memcpy(dst, p, (size_t)(run_end - p));
+        dst += run_end - p;
+        p = run_end;
+        if (p == s_end)
+            break;
+        unsigned char c = (unsigned char)*p;
+        dst[0] = '%';
+        dst[1] = StrHexDigitsUpper[c >> 4];
+        dst[2] = StrHexDigitsUpper[c & 0x0F];
+        dst += 3;
+    }
+    *dst = 0;
+    STR_ASSERT(dst == Data + idx + add_len);
+    set_length(idx + add_len);
+    return add_len;
+}
+
+int     Str::append_hex_from(int idx, const void* data, int size)
+{
+    const char* s = (const char*)data;
+    if (points_into(s))
+    {
+        Str tmp;
+        tmp.set(s, s + size);
+        return append_hex_from(idx, tmp.c_str(), size);
+    }
+
+    int add_len = size * 2;
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    char* dst = Data + idx;
+    int n = 0;
+#if STR_USE_SSE2
+    // Nibble to digit: '0' + n, plus 'a' - '0' - 10 for n > 9. Then interleave high and low digits.
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    for (; n + 16 <= size; n += 16, dst += 32)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(s + n));
+        const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask);
+        const __m128i lo = _mm_and_si128(v, nibble_mask);
+        const __m128i hi_digits = _mm_add_epi8(_mm_add_epi8(hi, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(hi, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10)));
+        const __m128i lo_digits = _mm_add_epi8(_mm_add_epi8(lo, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(lo, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10)));
+        _mm_storeu_si128((__m128i*)(void*)dst, _mm_unpacklo_epi8(hi_digits, lo_digits));
+        _mm_storeu_si128((__m128i*)(void*)(dst + 16), _mm_unpackhi_epi8(hi_digits, lo_digits));
+    }
+#endif
+    for (; n < size; n++, dst += 2)
+    {
+        unsigned char c = (unsigned char)s[n];
+        dst[0] = StrHexDigitsLower[c >> 4];
+        dst[1] = StrHexDigitsLower[c & 0x0F];
+    }
+    *dst = 0;
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    return add_len;
+}
+
+// No SSE2 code path: 3 to 4 bytes expansion needs a byte shuffle (SSSE3)
+int     Str::append_base64_from(int idx, const void* data, int size)
+{
+    const unsigned char* s = (const unsigned char*)data;
+    if (points_into((const char*)s))
+    {
+        Str tmp;
+        tmp.set((const char*)s, (const char*)s + size);
+        return append_base64_from(idx, tmp.c_str(), size);
+    }
+
+    int add_len = ((size + 2) / 3) * 4;
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    char* dst = Data + idx;
+    int n = 0;
+    for (; n + 3 <= size; n += 3, dst += 4)
+    {
+        unsigned int v = ((unsigned int)s[n] << 16) | ((unsigned int)s[n + 1] << 8) | s[n + 2];
+        dst[0] = StrBase64Chars[v >> 18];
+        dst[1] = StrBase64Chars[(v >> 12) & 0x3F];
+        dst[2] = StrBase64Chars[(v >> 6) & 0x3F];
+        dst[3] = StrBase64Chars[v & 0x3F];
+    }
+    if (n < size)
+    {
+        unsigned int v = ((unsigned int)s[n] << 16) | ((n + 1 < size) ? ((unsigned int)s[n + 1] << 8) : 0);
+        dst[0] = StrBase64Chars[v >> 18];
+        dst[1] = StrBase64Chars[(v >> 12) & 0x3F];
+        dst[2] = (n + 1 < size) ? StrBase64Chars[(v >> 6) & 0x3F] : '=';
+        dst[3] = '=';
+        dst += 4;
+    }
+    *dst = 0;
+    STR_ASSERT(cur_owned());
+    set_length(idx + add_len);
+    return add_len;
+}
+
+static inline int StrParseHex4(const char* p)
+{
+    int v = 0;
+    for (int n = 0; n < 4; n++)
+    {
+        int d = StrHexDigitValue((unsigned char)p[n]);
+        if (d < 0)
+            return -1;
+        v = (v << 4) | d;
+    }
+    return v;
+}
+
+// Decoders reserve for the source length, which is an upper bound of their output
+int     Str::append_json_unescaped_from(int idx, const StrView& src)
+{
+    if (points_into(src.Begin))
+    {
+        Str tmp;
+        tmp.set(src);
+        return append_json_unescaped_from(idx, StrView(tmp.c_str(), tmp.c_str() + src.length()));
+    }
+
+    const char* p = src.Begin;
+    const char* p_end = src.End;
+    if (!cur_owned() || cur_capacity() < idx + src.length())
+        reserve(idx + src.length());
+    char* dst = Data + idx;
+    for (;;)
+    {
+        const char* run_end = p ? (const char*)memchr(p, '\\', (size_t)(p_end - p)) : NULL;
+        if (run_end == NULL)
+            run_end = p_end;
+        if (run_end != p)
+            memcpy(dst, p, (size_t)(run_end - p));
+        dst += run_end - p;
+        p = run_end;
+        if (p == p_end)
+            break;
+        if (p + 1 == p_end)
+            return decode_failed(idx);
+        char c = p[1];
+        p += 2;
+        switch (c)
+        {
+        case '"':   *dst++ = '"'; break;
+        case '\\':  *dst++ = '\\'; break;
+        case '/':   *dst++ = '/'; break;
+        case 'b':   *dst++ = '\b'; break;
+        case 'f':   *dst++ = '\f'; break;
+        case 'n':   *dst++ = '\n'; break;
+        case 'r':   *dst++ = '\r'; break;
+        case 't':   *dst++ = '\t'; break;
+        case 'u':
+        {
+            int cp = (p_end - p >= 4) ? StrParseHex4(p) : -1;
+            if (cp < 0 || (cp >= 0xDC00 && cp <= 0xDFFF))
+                return decode_failed(idx);
+            p += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF)
+            {
+                // High surrogate must be followed by an escaped low surrogate
+                int lo = (p_end - p >= 6 && p[0] == '\\' && p[1] == 'u') ? StrParseHex4(p + 2) : -1;
+                if (lo < 0xDC00 || lo > 0xDFFF)
+                    return decode_failed(idx);
+                p += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            }
+            if (cp < 0x80)
+            {
+                *dst++ = (char)cp;
+            }
+            else if (cp < 0x800)
+            {
+                *dst++ = (char)(0xC0 | (cp >> 6));
+                *dst++ = (char)(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                *dst++ = (char)(0xE0 | (cp >> 12));
+                *dst++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                *dst++ = (char)(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                *dst++ = (char)(0xF0 | (cp >> 18));
+                *dst++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+                *dst++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                *dst++ = (char)(0x80 | (cp & 0x3F));
+            }
+            break;
+        }
+        default:
+            return decode_failed(idx);
+        }
+    }
+    *dst = 0;
+    int add_len = (int)(dst - (Data + idx));
+    set_length(idx + add_len);
+    return add_len;
+}
+
+int     Str::append_url_decoded_from(int idx, const StrView& src)
+{
+    if (points_into(src.Begin))
+    {
+        Str tmp;
+        tmp.set(src);
+        return append_url_decoded_from(idx, StrView(tmp.c_str(), tmp.c_str() + src.length()));
+    }
+
+    const char* p = src.Begin;
+    const char* p_end = src.End;
+    if (!cur_owned() || cur_capacity() < idx + src.length())
+        reserve(idx + src.length());
+    char* dst = Data + idx;
+    for (;;)
+    {
+        const char* run_end = p ? (const char*)memchr(p, '%', (size_t)(p_end - p)) : NULL;
+        if (run_end == NULL)
+            run_end = p_end;
+        if (run_end != p)
+            memcpy(dst, p, (size_t)(run_end - p));
+        dst += run_end - p;
+        p = run_end;
+        if (p == p_end)
+            break;
+        int hi = (p_end - p >= 3) ? StrHexDigitValue((unsigned char)p[1]) : -1;
+        int lo = (hi >= 0) ? StrHexDigitValue((unsigned char)p[2]) : -1;
+        if (lo < 0)
+            return decode_failed(idx);
+        *dst++ = (char)((hi << 4) | lo);
+        p += 3;
+    }
+    *dst = 0;
+    int add_len = (int)(dst - (Data + idx));
+    set_length(idx + add_len);
+    return add_len;
+}
+
+int     Str::append_hex_decoded_from(int idx, const StrView& src)
+{
+    if (points_into(src.Begin))
+    {
+        Str tmp;
+        tmp.set(src);
+        return append_hex_decoded_from(idx, StrView(tmp.c_str(), tmp.c_str() + src.length()));
+    }
+
+    int src_len = src.length();
+    int add_len = src_len / 2;
+    if (!cur_owned() || cur_capacity() < idx + add_len)
+        reserve(idx + add_len);
+    if (src_len & 1)
+        return decode_failed(idx);
+    const char* p = src.Begin;
+    char* dst = Data + idx;
+    for (int n = 0; n < add_len; n++, p += 2)
+    {
+        int hi = StrHexDigitValue((unsigned char)p[0]);
+        int lo = StrHexDigitValue((unsigned char)p[1]);
+        if ((hi | lo) < 0)
+            return decode_failed(idx);
+        dst[n] = (char)((hi << 4) | lo);
+    }
+    dst[add_len] = 0;
+    set_length(idx + add_len);
+    return add_len;
+}
+
+int     Str::append_base64_decoded_from(int idx, const StrView& src)
+{
+    if (points_into(src.Begin))
+    {
+        Str tmp;
+        tmp.set(src);
+        return append_base64_decoded_from(idx, StrView(tmp.c_str(), tmp.c_str() + src.length()));
+    }
+
+    const unsigned char* p = (const unsigned char*)src.Begin;
+    int src_len = src.length();
+    if (!cur_owned() || cur_capacity() < idx + src_len)
+        reserve(idx + src_len);
+    if ((src_len & 3) == 0 && src_len > 0 && p[src_len - 1] == '=')
+        src_len -= (p[src_len - 2] == '=') ? 2 : 1;
+    if ((src_len & 3) == 1)
+        return decode_failed(idx);
+    char* dst = Data + idx;
+    int n = 0;
+    for (; n + 4 <= src_len; n += 4, dst += 3)
+    {
+        int a = StrBase64Value(p[n]), b = StrBase64Value(p[n + 1]), c = StrBase64Value(p[n + 2]), d = StrBase64Value(p[n + 3]);
+        if ((a | b | c | d) < 0)
+            return decode_failed(idx);
+        unsigned int v = ((unsigned int)a << 18) | ((unsigned int)b << 12) | ((unsigned int)c << 6) | (unsigned int)d;
+        dst[0] = (char)(v >> 16);
+        dst[1] = (char)(v >> 8);
+        dst[2] = (char)v;
+    }
+    if (n < src_len)
+    {
+        // 2 or 3 characters left: 1 or 2 bytes
+        int a = StrBase64Value(p[n]), b = StrBase64Value(p[n + 1]), c = (n + 2 < src_len) ? StrBase64Value(p[n + 2]) : 0;
+        if ((a | b | c) < 0)
+            return decode_failed(idx);
+        unsigned int v = ((unsigned int)a << 18) | ((unsigned int)b << 12) | ((unsigned int)c << 6);
+        *dst++ = (char)(v >> 16);
+        if (n + 2 < src_len)
+            *dst++ = (char)(v >> 8);
+    }
+    *dst = 0;
+    int add_len = (int)(dst - (Data + idx));
+    set_length(idx + add_len);
+    return add_len;
+}
+
+
+//-------------------------------------------------------------------------
+// Splitting
+//-------------------------------------------------------------------------
+
+StrSplit::StrSplit(const StrView& src, char separator, StrSplitFlags flags, int max_splits)
+{
+    Cur = src.Begin ? src.Begin : "";
+    End = src.Begin ? src.End : Cur;
+    Separator = NULL;
+    SeparatorLen = 1;
+    Flags = flags & ~StrSplitFlags_AnyOf;
+    SplitsLeft = max_splits;
+    Done = false;
+    memset(SeparatorSet, 0, sizeof(SeparatorSet));
+    SeparatorSet[0] = (unsigned char)separator; // Single char mode stores the character here
+}
+
+StrSplit::StrSplit(const StrView& src, const char* separator, StrSplitFlags flags, int max_splits)
+{
+    Cur = src.Begin ? src.Begin : "";
+    End = src.Begin ? src.End : Cur;
+    Separator = separator;
+    SeparatorLen = (int)strlen(separator);
+    Flags = flags;
+    SplitsLeft = max_splits;
+    Done = false;
+    memset(SeparatorSet, 0, sizeof(SeparatorSet));
+    STR_ASSERT(SeparatorLen > 0);
+    if (Flags & StrSplitFlags_AnyOf)
+        for (const unsigned char* c = (const unsigned char*)separator; *c; c++)
+            SeparatorSet[*c >> 5] |= 1u << (*c & 31);
+}
+
+static inline bool StrIsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool    StrSplit::next(StrView* out_field)
+{
+    while (!Done)
+    {
+        // Find next separator
+        const char* field_b = Cur;
+        const char* field_e = NULL;
+        if (SplitsLeft != 0)
+        {
+            if (Separator == NULL)
+            {
+                field_e = (const char*)memchr(Cur, (int)SeparatorSet[0], (size_t)(End - Cur));
+            }
+            else if (Flags & StrSplitFlags_AnyOf)
+            {
+                for (const char* p = Cur; p < End; p++)
+                    if (SeparatorSet[(unsigned char)*p >> 5] & (1u << ((unsigned char)*p & 31)))
+                    {
+                        field_e = p;
+                        break;
+                    }
+            }
+            else
+            {
+                field_e = StrFindSubstr(Cur, (int)(End - Cur), Separator, SeparatorLen);
+            }
+        }
+        if (field_e != NULL)
+        {
+            Cur = field_e + ((Flags & StrSplitFlags_AnyOf) ? 1 : SeparatorLen);
+            if (SplitsLeft > 0)
+                SplitsLeft--;
+        }
+        else
+        {
+            field_e = End;
+            Done = true;
+        }
+
+        if (Flags & StrSplitFlags_TrimWhitespace)
+        {
+            while (field_b < field_e && StrIsBlank(field_b[0]))
+                field_b++;
+            while (field_e > field_b && StrIsBlank(field_e[-1]))
+                field_e--;
+        }
+        if ((Flags & StrSplitFlags_SkipEmpty) && field_b == field_e)
+            continue;
+        *out_field = StrView(field_b, field_e);
+        return true;
+    }
+    return false;
+}
+
+
+//-------------------------------------------------------------------------
+// Builder
+//-------------------------------------------------------------------------
+
+#ifdef _WIN32
+#include <io.h>         // for _write
+#else
+#include <sys/uio.h>    // for writev
+#include <limits.h>     // for IOV_MAX
+#include <errno.h>
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+#endif
+
+struct StrBuilderChunk
+{
+    StrBuilderChunk*    Next;
+    int                 Size;
+    int                 Used;
+    inline char*        data()                                  { return (char*)(this + 1); }
+};
+
+StrBuilder::StrBuilder(int chunk_size)
+{
+    STR_ASSERT(chunk_size > 0);
+    First = Last = NULL;
+    TotalLen = 0;
+    ChunkSize = chunk_size;
+}
+
+StrBuilder::~StrBuilder()
+{
+    clear();
+}
+
+void    StrBuilder::clear()
+{
+    while (First)
+    {
+        StrBuilderChunk* next = First->Next;
+        STR_MEMFREE(First);
+        First = next;
+    }
+    Last = NULL;
+    TotalLen = 0;
+}
+
+char*   StrBuilder::alloc_contiguous(int size)
+{
+    if (Last == NULL || Last->Size - Last->Used < size)
+    {
+        int chunk_size = size > ChunkSize ? size : ChunkSize;
+        StrBuilderChunk* chunk = (StrBuilderChunk*)STR_MEMALLOC(sizeof(StrBuilderChunk) + (size_t)chunk_size);
+        chunk->Next = NULL;
+        chunk->Size = chunk_size;
+        chunk->Used = 0;
+        if (Last)
+            Last->Next = chunk;
+        else
+            First = chunk;
+        Last = chunk;
+    }
+    return Last->data() + Last->Used;
+}
+
+void    StrBuilder::append(char c)
+{
+    char* dst = alloc_contiguous(1);
+    *dst = c;
+    Last->Used++;
+    TotalLen++;
+}
+
+void    StrBuilder::append(const char* s, const char* s_end)
+{
+    if (!s_end)
+        s_end = s + strlen(s);
+    size_t len = (size_t)(s_end - s);
+    TotalLen += len;
+    while (len > 0)
+    {
+        // Fill remaining space of last chunk, then continue in a new one
+        if (Last == NULL || Last->Used == Last->Size)
+            alloc_contiguous(1);
+        size_t copy_len = (size_t)(Last->Size - Last->Used);
+        if (copy_len > len)
+            copy_len = len;
+        memcpy(Last->data() + Last->Used, s, copy_len);
+        Last->Used += (int)copy_len;
+        s += copy_len;
+        len -= copy_len;
+    }
+}
+
+void    StrBuilder::appendfv(const char* fmt, va_list args)
+{
+    // Try formatting in the remaining space of the last chunk, which is enough most of the time
+    va_list args2;
+    va_copy(args2, args);
+    int avail = Last ? Last->Size - Last->Used : 0;
+    int len = vsnprintf(Last ? Last->data() + Last->Used : NULL, (size_t)avail, fmt, args);
+    STR_ASSERT(len >= 0);
+    if (len >= avail)
+    {
+        // vsnprintf() needs room for a zero terminator
+        char* dst = alloc_contiguous(len + 1);
+        vsnprintf(dst, (size_t)len + 1, fmt, args2);
+    }
+    va_end(args2);
+    Last->Used += len;
+    TotalLen += (size_t)len;
+}
+
+void    StrBuilder::appendf(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    appendfv(fmt, args);
+    va_end(args);
+}
+
+void    StrBuilder::append_int(long long v)
+{
+    Str30 tmp;
+    tmp.append_int_from(0, v);
+    append(tmp.c_str(), tmp.c_str() + tmp.length());
+}
+
+void    StrBuilder::append_uint(unsigned long long v)
+{
+    Str30 tmp;
+    tmp.append_uint_from(0, v);
+    append(tmp.c_str(), tmp.c_str() + tmp.length());
+}
+
+void    StrBuilder::append_hex(unsigned long long v)
+{
+    Str30 tmp;
+    tmp.append_hex_from(0, v);
+    append(tmp.c_str(), tmp.c_str() + tmp.length());
+}
+
+void    StrBuilder::append_float(double v, int precision)
+{
+    Str64 tmp;
+    int len = tmp.append_float_from(0, v, precision);
+    append(tmp.c_str(), tmp.c_str() + len);
+}
+
+void    StrBuilder::flatten(Str& out) const
+{
+    STR_ASSERT(TotalLen <= (size_t)STR_CAPACITY_MAX);
+    out.reserve_discard((int)TotalLen);
+    char* dst = out.c_str();
+    for (StrBuilderChunk* chunk = First; chunk != NULL; chunk = chunk->Next)
+    {
+        memcpy(dst, chunk->data(), (size_t)chunk->Used);
+        dst += chunk->Used;
+    }
+    *dst = 0;
+    out.update_length();
+}
+
+bool    StrBuilder::write(FILE* f) const
+{
+    for (StrBuilderChunk* chunk = First; chunk != NULL; chunk = chunk->Next)
+        if (fwrite(chunk->data(), 1, (size_t)chunk->Used, f) != (size_t)chunk->Used)
+            return false;
+    return true;
+}
+
+bool    StrBuilder::write(int fd) const
+{
+#ifdef _WIN32
+    for (StrBuilderChunk* chunk = First; chunk != NULL; chunk = chunk->Next)
+        for (int written = 0; written < chunk->Used; )
+        {
+            int w = _write(fd, chunk->data() + written, (unsigned int)(chunk->Used - written));
+            if (w <= 0)
+                return false;
+            written += w;
+        }
+    return true;
+#else
+    // Gather up to IOV_MAX chunks per call, resuming after partial writes
+    const int IOV_BATCH = IOV_MAX < 64 ? IOV_MAX : 64;
+    struct iovec iov[64];
+    StrBuilderChunk* chunk = First;
+    size_t chunk_offset = 0;
+    while (chunk != NULL)
+    {
+        int iov_count = 0;
+        size_t offset = chunk_offset;
+        for (StrBuilderChunk* c = chunk; c != NULL && iov_count < IOV_BATCH; c = c->Next, offset = 0)
+        {
+            if ((size_t)c->Used == offset)
+                continue;
+            iov[iov_count].iov_base = c->data() + offset;
+            iov[iov_count].iov_len = (size_t)c->Used - offset;
+            iov_count++;
+        }
+        if (iov_count == 0)
+            break;
+        ssize_t w = writev(fd, iov, iov_count);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        // Advance by 'w' bytes
+        size_t remaining = (size_t)w;
+        while (chunk != NULL && remaining >= (size_t)chunk->Used - chunk_offset)
+        {
+            remaining -= (size_t)chunk->Used - chunk_offset;
+            chunk = chunk->Next;
+            chunk_offset = 0;
+        }
+        chunk_offset += remaining;
+    }
+    return true;
+#endif
+}
+
+
+//-------------------------------------------------------------------------
+// Statistics (STR_ENABLE_STATS)
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_STATS
+
+#include <atomic>
+#include <mutex>
+
+#define STR_STATS_SLOTS     64                  // Distinct local buffer sizes tracked per thread, others are merged in an overflow slot
+
+// Counters are only written by their owning thread, atomics make it safe to read them from Str::GetStats() on another thread.
+struct StrStatsSlot
+{
+    std::atomic<int>                LocalBufSize;   // -1 when unused
+    std::atomic<unsigned long long> Counters[StrStatsCounter_COUNT];
+    std::atomic<unsigned long long> LengthHistogram[STR_STATS_HISTOGRAM_BUCKETS];
+};
+
+struct StrStatsThreadData
+{
+    StrStatsSlot        Slots[STR_STATS_SLOTS + 1];
+    StrStatsThreadData* Next;
+    StrStatsThreadData* Prev;
+    bool                Registered;
+    StrStatsThreadData(bool register_thread);
+    ~StrStatsThreadData();
+};
+
+struct StrStatsGlobals
+{
+    std::mutex          Mutex;
+    StrStatsThreadData* Threads = NULL;         // Live threads
+    StrStatsThreadData* Retired = NULL;         // Counters of exited threads, merged together
+};
+
+static StrStatsGlobals& StrStatsGetGlobals()
+{
+    static StrStatsGlobals* globals = new StrStatsGlobals(); // Never destructed, Str instances may be destructed very late
+    return *globals;
+}
+
+static void StrStatsClearThreadData(StrStatsThreadData* data)
+{
+    for (StrStatsSlot& slot : data->Slots)
+    {
+        slot.LocalBufSize.store(-1, std::memory_order_relaxed);
+        for (auto& c : slot.Counters)
+            c.store(0, std::memory_order_relaxed);
+        for (auto& c : slot.LengthHistogram)
+            c.store(0, std::memory_order_relaxed);
+    }
+}
+
+static StrStatsSlot* StrStatsFindSlot(StrStatsThreadData* data, int local_buf_size, bool create)
+{
+    for (int probe = 0; probe < STR_STATS_SLOTS; probe++)
+    {
+        StrStatsSlot* slot = &data->Slots[((unsigned int)local_buf_size * 31u + (unsigned int)probe) % STR_STATS_SLOTS];
+        int key = slot->LocalBufSize.load(std::memory_order_relaxed);
+        if (key == local_buf_size)
+            return slot;
+        if (key == -1)
+        {
+            if (!create)
+                return NULL;
+            slot->LocalBufSize.store(local_buf_size, std::memory_order_release);
+            return slot;
+        }
+    }
+    if (!create)
+        return NULL;
+
+    // Overflow: keyed with a sentinel so that merging doesn't skip it as unused
+    StrStatsSlot* slot = &data->Slots[STR_STATS_SLOTS];
+    if (slot->LocalBufSize.load(std::memory_order_relaxed) == -1)
+        slot->LocalBufSize.store(STR_STATS_LOCAL_BUF_SIZE_OTHER, std::memory_order_release);
+    return slot;
+}
+
+StrStatsThreadData::StrStatsThreadData(bool register_thread)
+{
+    StrStatsClearThreadData(this);
+    Next = Prev = NULL;
+    Registered = register_thread;
+    if (!register_thread)
+        return;
+    StrStatsGlobals& g = StrStatsGetGlobals();
+    std::lock_guard<std::mutex> lock(g.Mutex);
+    Prev = NULL;
+    Next = g.Threads;
+    if (g.Threads)
+        g.Threads->Prev = this;
+    g.Threads = this;
+}
+
+StrStatsThreadData::~StrStatsThreadData()
+{
+    if (!Registered)
+        return;
+
+    // Merge into retired counters
+    StrStatsGlobals& g = StrStatsGetGlobals();
+    std::lock_guard<std::mutex> lock(g.Mutex);
+    if (g.Retired == NULL)
+        g.Retired = new StrStatsThreadData(false);
+    for (StrStatsSlot& slot : Slots)
+    {
+        int key = slot.LocalBufSize.load(std::memory_order_relaxed);
+        if (key == -1)
+            continue;
+        StrStatsSlot* dst = StrStatsFindSlot(g.Retired, key, true);
+        for (int n = 0; n < StrStatsCounter_COUNT; n++)
+            dst->Counters[n].fetch_add(slot.Counters[n].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        for (int n = 0; n < STR_STATS_HISTOGRAM_BUCKETS; n++)
+            dst->LengthHistogram[n].fetch_add(slot.LengthHistogram[n].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    if (Prev)
+        Prev->Next = Next;
+    else
+        g.Threads = Next;
+    if (Next)
+        Next->Prev = Prev;
+}
+
+// Trivially destructible pointer, so that stats are dropped rather than crashing for Str destructed after the thread data (e.g. globals)
+static thread_local StrStatsThreadData* GStrStatsThreadPtr = NULL;
+static thread_local bool                GStrStatsThreadExited = false;
+
+struct StrStatsThreadOwner
+{
+    StrStatsThreadData  Data;
+    StrStatsThreadOwner() : Data(true) { GStrStatsThreadPtr = &Data; }
+    ~StrStatsThreadOwner()  { GStrStatsThreadPtr = NULL; GStrStatsThreadExited = true; }
+};
+
+static inline StrStatsSlot* StrStatsGetThreadSlot(int local_buf_size)
+{
+    if (GStrStatsThreadPtr == NULL)
+    {
+        if (GStrStatsThreadExited)
+            return NULL;
+        static thread_local StrStatsThreadOwner owner;
+        (void)owner;
+    }
+    return StrStatsFindSlot(GStrStatsThreadPtr, local_buf_size, true);
+}
+
+static inline void StrStatsIncrement(std::atomic<unsigned long long>& counter, unsigned long long value)
+{
+    // Single writer: a plain load/store pair is enough and much cheaper than fetch_add()
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void    StrStatsAdd(int local_buf_size, StrStatsCounter counter, unsigned long long value)
+{
+    if (StrStatsSlot* slot = StrStatsGetThreadSlot(local_buf_size))
+        StrStatsIncrement(slot->Counters[counter], value);
+}
+
+void    StrStatsAddLength(int local_buf_size, int length)
+{
+    int bucket = 0;
+    while (length > 0 && bucket < STR_STATS_HISTOGRAM_BUCKETS - 1)
+    {
+        length >>= 1;
+        bucket++;
+    }
+    if (StrStatsSlot* slot = StrStatsGetThreadSlot(local_buf_size))
+        StrStatsIncrement(slot->LengthHistogram[bucket], 1);
+}
+
+static void StrStatsMergeInto(StrStatsEntry* entries, int* entries_count, int max_entries, const StrStatsThreadData* data)
+{
+    for (const StrStatsSlot& slot : data->Slots)
+    {
+        int key = slot.LocalBufSize.load(std::memory_order_acquire);
+        if (key == -1)
+            continue;
+        StrStatsEntry* entry = NULL;
+        for (int n = 0; n < *entries_count && entry == NULL; n++)
+            if (entries[n].LocalBufSize == key)
+                entry = &entries[n];
+        if (entry == NULL)
+        {
+            if (*entries_count == max_entries)
+                continue;
+            entry = &entries[(*entries_count)++];
+            memset(entry, 0, sizeof(*entry));
+            entry->LocalBufSize = key;
+        }
+        for (int n = 0; n < StrStatsCounter_COUNT; n++)
+            entry->Counters[n] += slot.Counters[n].load(std::memory_order_relaxed);
+        for (int n = 0; n < STR_STATS_HISTOGRAM_BUCKETS; n++)
+            entry->LengthHistogram[n] += slot.LengthHistogram[n].load(std::memory_order_relaxed);
+    }
+}
+
+int     Str::GetStats(StrStatsEntry* out_entries, int max_entries)
+{
+    StrStatsGlobals& g = StrStatsGetGlobals();
+    std::lock_guard<std::mutex> lock(g.Mutex);
+    int count = 0;
+    for (StrStatsThreadData* data = g.Threads; data != NULL; data = data->Next)
+        StrStatsMergeInto(out_entries, &count, max_entries, data);
+    if (g.Retired)
+        StrStatsMergeInto(out_entries, &count, max_entries, g.Retired);
+
+    // Sort by local buffer size, other sizes last
+    for (int i = 1; i < count; i++)
+        for (int j = i; j > 0 && (unsigned int)out_entries[j - 1].LocalBufSize > (unsigned int)out_entries[j].LocalBufSize; j--)
+        {
+            StrStatsEntry tmp = out_entries[j];
+            out_entries[j] = out_entries[j - 1];
+            out_entries[j - 1] = tmp;
+        }
+    return count;
+}
+
+void    Str::DumpStats(FILE* out)
+{
+    if (out == NULL)
+        out = stdout;
+    StrStatsEntry entries[STR_STATS_SLOTS + 1];
+    int count = GetStats(entries, STR_STATS_SLOTS + 1);
+    fprintf(out, "%-10s %12s %12s %7s %12s %10s %10s %10s %10s\n", "LocalBuf", "Constructed", "Spills", "Spill%", "HeapBytes", "Reallocs", "FmtRetry", "LenP50<=", "LenP99<=");
+    for (int n = 0; n < count; n++)
+    {
+        const StrStatsEntry& e = entries[n];
+        unsigned long long constructed = e.Counters[StrStatsCounter_Constructions];
+        unsigned long long destructed = 0;
+        for (int b = 0; b < STR_STATS_HISTOGRAM_BUCKETS; b++)
+            destructed += e.LengthHistogram[b];
+        int percentile_bucket[2] = { -1, -1 };
+        unsigned long long cumulated = 0;
+        for (int b = 0; b < STR_STATS_HISTOGRAM_BUCKETS; b++)
+        {
+            cumulated += e.LengthHistogram[b];
+            if (percentile_bucket[0] == -1 && cumulated * 100 >= destructed * 50)
+                percentile_bucket[0] = b;
+            if (percentile_bucket[1] == -1 && cumulated * 100 >= destructed * 99)
+                percentile_bucket[1] = b;
+        }
+        char local_buf_size[16];
+        if (e.LocalBufSize == STR_STATS_LOCAL_BUF_SIZE_OTHER)
+            strcpy(local_buf_size, "Other");
+        else
+            snprintf(local_buf_size, sizeof(local_buf_size), "%d", e.LocalBufSize);
+        fprintf(out, "%-10s %12llu %12llu %6.1f%% %12llu %10llu %10llu %10lld %10lld\n",
+            local_buf_size, constructed, e.Counters[StrStatsCounter_Spills],
+            constructed ? 100.0 * (double)e.Counters[StrStatsCounter_Spills] / (double)constructed : 0.0,
+            e.Counters[StrStatsCounter_HeapBytes], e.Counters[StrStatsCounter_Reallocs], e.Counters[StrStatsCounter_FormatRetries],
+            percentile_bucket[0] > 0 ? (1LL << percentile_bucket[0]) - 1 : 0LL, percentile_bucket[1] > 0 ? (1LL << percentile_bucket[1]) - 1 : 0LL);
+    }
+}
+
+#endif // #if STR_ENABLE_STATS
+
+
+//-------------------------------------------------------------------------
+// Files
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_FILES
+
+#ifdef _WIN32
+#include <io.h>         // for _open, _read, _close
+#include <fcntl.h>
+#else
+#include <sys/mman.h>   // for mmap
+#include <sys/stat.h>
+#include <fcntl.h>      // for open
+#include <unistd.h>     // for read, close, sysconf
+#include <errno.h>
+#endif
+
+struct StrMappedFile
+{
+    char*               Data;                   // NULL for an empty file
+    size_t              Size;
+    void*               Base;                   // Release with StrUnmapFile(Base, BaseSize)
+    size_t              BaseSize;
+};
+
+#ifdef _WIN32
+
+// No equivalent to MAP_FIXED to place the file right after our header, load into a heap block instead.
+static bool StrMapFile(const char* path, size_t header_size, StrMappedFile* out)
+{
+    memset(out, 0, sizeof(*out));
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+    long long file_size = (_fseeki64(f, 0, SEEK_END) == 0) ? _ftelli64(f) : -1;
+    if (file_size < 0 || _fseeki64(f, 0, SEEK_SET) != 0)
+    {
+        fclose(f);
+        return false;
+    }
+    if (file_size == 0)
+    {
+        fclose(f);
+        return true;
+    }
+    char* block = (char*)STR_MEMALLOC(header_size + (size_t)file_size + 1);
+    char* data = block + header_size;
+    bool ok = fread(data, 1, (size_t)file_size, f) == (size_t)file_size;
+    fclose(f);
+    if (!ok)
+    {
+        STR_MEMFREE(block);
+        return false;
+    }
+    data[file_size] = 0;
+    out->Data = data;
+    out->Size = (size_t)file_size;
+    out->Base = block;
+    out->BaseSize = header_size + (size_t)file_size + 1;
+    return true;
+}
+
+static void StrUnmapFile(void* base, size_t)
+{
+    STR_MEMFREE(base);
+}
+
+#else
+
+// Layout: [ anonymous page, ending with 'header_size' bytes ][ file pages ][ anonymous zero page ]
+// The file is mapped with MAP_FIXED over the middle of an anonymous reservation, so the header is right before the data,
+// and the zero terminator comes either from the zero-filled tail of the last file page or from the last anonymous page.
+static bool StrMapFile(const char* path, size_t header_size, StrMappedFile* out)
+{
+    memset(out, 0, sizeof(*out));
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        return true;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    STR_ASSERT(header_size <= page_size);
+    (void)header_size;
+    size_t map_size = page_size + ((file_size + page_size - 1) & ~(page_size - 1)) + page_size;
+    char* base = (char*)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == (char*)MAP_FAILED)
+    {
+        ::close(fd);
+        return false;
+    }
+    char* data = base + page_size;
+    if (mmap(data, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(base, map_size);
+        ::close(fd);
+        return false;
+    }
+    ::close(fd);
+    out->Data = data;
+    out->Size = file_size;
+    out->Base = base;
+    out->BaseSize = map_size;
+    return true;
+}
+
+static void StrUnmapFile(void* base, size_t size)
+{
+    munmap(base, size);
+}
+
+#endif
+
+bool    Str::map_file(const char* path)
+{
+    clear();
+    StrMappedFile file;
+    if (!StrMapFile(path, sizeof(StrSharedHeader), &file))
+        return false;
+    if (file.Data == NULL)
+        return true;
+    if (file.Size > (size_t)STR_CAPACITY_MAX) // Capacity must hold the size so that detaching on write copies everything
+    {
+        StrUnmapFile(file.Base, file.BaseSize);
+        return false;
+    }
+    StrSharedHeader* header = new (file.Data - sizeof(StrSharedHeader)) StrSharedHeader();
+    header->RefCount.store(1, std::memory_order_relaxed);
+    header->MappedBase = file.Base;
+    header->MappedSize = file.BaseSize;
+    Data = file.Data;
+    Capacity = (int)file.Size;
+    Owned = 0;
+    set_length((int)file.Size);
+    return true;
+}
+
+StrLineReader::StrLineReader(int fd, int block_size)
+{
+    STR_ASSERT(block_size > 0);
+    Buf = (char*)STR_MEMALLOC((size_t)block_size);
+    BufSize = block_size;
+    Begin = End = ScanFrom = 0;
+    Fd = fd;
+    OwnFd = false;
+    Eof = Error = false;
+    LineNumber = 0;
+}
+
+StrLineReader::~StrLineReader()
+{
+    close();
+    STR_MEMFREE(Buf);
+}
+
+bool    StrLineReader::open(const char* path)
+{
+    close();
+#ifdef _WIN32
+    Fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+    Fd = ::open(path, O_RDONLY | O_CLOEXEC);
+#endif
+    OwnFd = (Fd >= 0);
+    Error = (Fd < 0);
+    return Fd >= 0;
+}
+
+void    StrLineReader::close()
+{
+    if (OwnFd)
+#ifdef _WIN32
+        _close(Fd);
+#else
+        ::close(Fd);
+#endif
+    Fd = -1;
+    OwnFd = false;
+    Begin = End = ScanFrom = 0;
+    Eof = Error = false;
+    LineNumber = 0;
+}
+
+bool    StrLineReader::next(StrView* out_line)
+{
+    for (;;)
+    {
+        if (const char* nl = (const char*)memchr(Buf + ScanFrom, '\n', (size_t)(End - ScanFrom)))
+        {
+            const char* line_end = (nl > Buf + Begin && nl[-1] == '\r') ? nl - 1 : nl;
+            *out_line = StrView(Buf + Begin, line_end);
+            Begin = ScanFrom = (int)(nl + 1 - Buf);
+            LineNumber++;
+            return true;
+        }
+        ScanFrom = End;
+        if (Eof || Fd < 0)
+        {
+            if (Begin == End)
+                return false;
+            const char* line_end = (Buf[End - 1] == '\r') ? Buf + End - 1 : Buf + End;
+            *out_line = StrView(Buf + Begin, line_end);
+            Begin = ScanFrom = End;
+            LineNumber++;
+            return true;
+        }
+
+        // Move partial line to the start of the buffer, grow if it fills the whole buffer, then read next block
+        if (Begin > 0)
+        {
+            memmove(Buf, Buf + Begin, (size_t)(End - Begin));
+            End -= Begin;
+            ScanFrom -= Begin;
+            Begin = 0;
+        }
+        if (End == BufSize)
+        {
+            char* new_buf = (char*)STR_MEMALLOC((size_t)BufSize * 2);
+            memcpy(new_buf, Buf, (size_t)End);
+            STR_MEMFREE(Buf);
+            Buf = new_buf;
+            BufSize *= 2;
+        }
+#ifdef _WIN32
+        int r = _read(Fd, Buf + End, (unsigned int)(BufSize - End));
+#else
+        int r = (int)read(Fd, Buf + End, (size_t)(BufSize - End));
+        if (r < 0 && errno == EINTR)
+            continue;
+#endif
+        if (r <= 0)
+        {
+            Error = (r < 0);
+            Eof = true;
+            continue;
+        }
+        End += r;
+    }
+}
+
+bool    StrLineReader::next(Str* out_line)
+{
+    StrView line;
+    if (!next(&line))
+        return false;
+    out_line->set(line);
+    return true;
+}
+
+#endif // #if STR_ENABLE_FILES
+
+//-------------------------------------------------------------------------
+// Table
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_TABLE
+
+// Blob layout: header, Entries[Count], Chars[CharsSize]
+struct StrTableBlobHeader
+{
+    char                Magic[8];
+    unsigned int        ByteOrderMark;
+    unsigned int        Count;
+    unsigned long long  CharsSize;
+};
+
+static const char           STR_TABLE_MAGIC[8] = { 'S', 'T', 'R', 'T', 'A', 'B', 'L', '1' };
+static const unsigned int   STR_TABLE_BYTE_ORDER_MARK = 0x01020304;
+
+// Resize a heap block of which 'used_size' bytes are in use
+static void* StrReallocBlock(void* p, size_t used_size, size_t new_size)
+{
+#ifdef STR_MEMREALLOC
+    (void)used_size;
+    return STR_MEMREALLOC(p, new_size);
+#else
+    void* new_p = STR_MEMALLOC(new_size);
+    if (p != NULL)
+    {
+        memcpy(new_p, p, used_size);
+        STR_MEMFREE(p);
+    }
+    return new_p;
+#endif
+}
+
+StrTable::StrTable()
+{
+    Chars = NULL;
+    CharsSize = CharsCapacity = 0;
+    Entries = NULL;
+    EntriesCount = EntriesCapacity = 0;
+    Owned = true;
+    MappedBase = NULL;
+    MappedSize = 0;
+}
+
+StrTable::~StrTable()
+{
+    clear();
+}
+
+void    StrTable::clear()
+{
+    if (Owned)
+    {
+        STR_MEMFREE(Chars);
+        STR_MEMFREE(Entries);
+    }
+    else if (MappedBase)
+    {
+        StrUnmapFile(MappedBase, MappedSize);
+    }
+    Chars = NULL;
+    CharsSize = CharsCapacity = 0;
+    Entries = NULL;
+    EntriesCount = EntriesCapacity = 0;
+    Owned = true;
+    MappedBase = NULL;
+    MappedSize = 0;
+}
+
+// Copy a loaded blob to the heap before modifying it
+void    StrTable::make_owned()
+{
+    if (Owned)
+        return;
+    char* chars = (char*)STR_MEMALLOC(CharsSize ? CharsSize : 1);
+    Entry* entries = (Entry*)STR_MEMALLOC(EntriesCount ? (size_t)EntriesCount * sizeof(Entry) : 1);
+    memcpy(chars, Chars, CharsSize);
+    memcpy(entries, Entries, (size_t)EntriesCount * sizeof(Entry));
+    if (MappedBase)
+        StrUnmapFile(MappedBase, MappedSize);
+    MappedBase = NULL;
+    MappedSize = 0;
+    Chars = chars;
+    CharsCapacity = CharsSize;
+    Entries = entries;
+    EntriesCapacity = EntriesCount;
+    Owned = true;
+}
+
+void    StrTable::reserve(int entries_count, size_t chars_size)
+{
+    make_owned();
+    STR_ASSERT((unsigned long long)chars_size <= 0xFFFFFFFFULL && "StrTable offsets are 32-bit");
+    if (entries_count > EntriesCapacity)
+    {
+        Entries = (Entry*)StrReallocBlock(Entries, (size_t)EntriesCount * sizeof(Entry), (size_t)entries_count * sizeof(Entry));
+        EntriesCapacity = entries_count;
+    }
+    if (chars_size > CharsCapacity)
+    {
+        Chars = (char*)StrReallocBlock(Chars, CharsSize, chars_size);
+        CharsCapacity = chars_size;
+    }
+}
+
+// Grow following STR_GROW_CAPACITY policy
+void    StrTable::grow(int add_entries, size_t add_chars)
+{
+    int entries_count = EntriesCapacity;
+    if (EntriesCount + add_entries > entries_count)
+    {
+        entries_count = (int)STR_GROW_CAPACITY((long long)EntriesCapacity);
+        if (entries_count < EntriesCount + add_entries)
+            entries_count = EntriesCount + add_entries;
+        if (entries_count < 16)
+            entries_count = 16;
+    }
+    size_t chars_size = CharsCapacity;
+    if (CharsSize + add_chars > chars_size)
+    {
+        chars_size = (size_t)STR_GROW_CAPACITY((long long)CharsCapacity);
+        if (chars_size < CharsSize + add_chars)
+            chars_size = CharsSize + add_chars;
+        if (chars_size < 256)
+            chars_size = 256;
+    }
+    reserve(entries_count, chars_size);
+}
+
+int     StrTable::append(const StrView& s)
+{
+    int len = s.length();
+    const char* src = s.Begin;
+    if (EntriesCount + 1 > EntriesCapacity || CharsSize + (size_t)len + 1 > CharsCapacity || !Owned)
+    {
+        // 's' may point into our own arena
+        bool aliased = Chars != NULL && src >= Chars && src < Chars + CharsSize;
+        size_t src_offset = aliased ? (size_t)(src - Chars) : 0;
+        grow(1, (size_t)len + 1);
+        if (aliased)
+            src = Chars + src_offset;
+    }
+    Entry* entry = &Entries[EntriesCount];
+    entry->Offset = (unsigned int)CharsSize;
+    entry->Length = (unsigned int)len;
+    if (len > 0)
+        memcpy(Chars + CharsSize, src, (size_t)len);
+    Chars[CharsSize + (size_t)len] = 0;
+    CharsSize += (size_t)len + 1;
+    return EntriesCount++;
+}
+
+int     StrTable::append_lines(const StrView& text)
+{
+    if (text.Begin == NULL || text.empty())
+        return 0;
+
+    // Count lines first to allocate once. Every line becomes at most as long as its text + zero terminator (which replaces the '\n').
+    int lines_count = 0;
+    for (const char* p = text.Begin; p < text.End; lines_count++)
+    {
+        const char* eol = (const char*)memchr(p, '\n', (size_t)(text.End - p));
+        p = eol ? eol + 1 : text.End;
+    }
+    reserve(EntriesCount + lines_count, CharsSize + (size_t)text.length() + 1);
+
+    for (const char* p = text.Begin; p < text.End; )
+    {
+        const char* eol = (const char*)memchr(p, '\n', (size_t)(text.End - p));
+        const char* line_end = eol ? eol : text.End;
+        const char* next = eol ? eol + 1 : text.End;
+        if (line_end > p && line_end[-1] == '\r')
+            line_end--;
+        size_t len = (size_t)(line_end - p);
+        Entry* entry = &Entries[EntriesCount++];
+        entry->Offset = (unsigned int)CharsSize;
+        entry->Length = (unsigned int)len;
+        memcpy(Chars + CharsSize, p, len);
+        Chars[CharsSize + len] = 0;
+        CharsSize += len + 1;
+        p = next;
+    }
+    return lines_count;
+}
+
+void    StrTable::set(int idx, const StrView& s)
+{
+    STR_ASSERT(idx >= 0 && idx < EntriesCount);
+    make_owned();
+    int len = s.length();
+    const char* src = s.Begin;
+    if ((unsigned int)len > Entries[idx].Length)
+    {
+        // Doesn't fit in place: append characters at the end of the arena
+        bool aliased = Chars != NULL && src >= Chars && src < Chars + CharsSize;
+        size_t src_offset = aliased ? (size_t)(src - Chars) : 0;
+        grow(0, (size_t)len + 1);
+        if (aliased)
+            src = Chars + src_offset;
+        Entries[idx].Offset = (unsigned int)CharsSize;
+        CharsSize += (size_t)len + 1;
+    }
+    char* dst = Chars + Entries[idx].Offset;
+    if (len > 0)
+        memmove(dst, src, (size_t)len);
+    dst[len] = 0;
+    Entries[idx].Length = (unsigned int)len;
+}
+
+void    StrTable::erase(int idx)
+{
+    STR_ASSERT(idx >= 0 && idx < EntriesCount);
+    make_owned();
+    memmove(Entries + idx, Entries + idx + 1, (size_t)(EntriesCount - idx - 1) * sizeof(Entry));
+    EntriesCount--;
+}
+
+void    StrTable::compact()
+{
+    make_owned();
+    size_t used_size = 0;
+    for (int n = 0; n < EntriesCount; n++)
+        used_size += (size_t)Entries[n].Length + 1;
+    if (used_size == CharsSize && CharsCapacity == CharsSize && EntriesCapacity == EntriesCount)
+        return;
+
+    // Copy strings in index order, which also restores locality after set()
+    char* chars = (char*)STR_MEMALLOC(used_size ? used_size : 1);
+    size_t offset = 0;
+    for (int n = 0; n < EntriesCount; n++)
+    {
+        size_t len = (size_t)Entries[n].Length;
+        memcpy(chars + offset, Chars + Entries[n].Offset, len + 1);
+        Entries[n].Offset = (unsigned int)offset;
+        offset += len + 1;
+    }
+    STR_MEMFREE(Chars);
+    if (EntriesCapacity > EntriesCount && EntriesCount > 0)
+    {
+        Entries = (Entry*)StrReallocBlock(Entries, (size_t)EntriesCount * sizeof(Entry), (size_t)EntriesCount * sizeof(Entry));
+        EntriesCapacity = EntriesCount;
+    }
+    Chars = chars;
+    CharsSize = CharsCapacity = used_size;
+}
+
+bool    StrTable::save(const char* path) const
+{
+    FILE* f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+    StrTableBlobHeader header;
+    memcpy(header.Magic, STR_TABLE_MAGIC, sizeof(header.Magic));
+    header.ByteOrderMark = STR_TABLE_BYTE_ORDER_MARK;
+    header.Count = (unsigned int)EntriesCount;
+    header.CharsSize = CharsSize;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (ok && EntriesCount > 0)
+        ok = fwrite(Entries, sizeof(Entry), (size_t)EntriesCount, f) == (size_t)EntriesCount;
+    if (ok && CharsSize > 0)
+        ok = fwrite(Chars, 1, CharsSize, f) == CharsSize;
+    if (fclose(f) != 0)
+        ok = false;
+    return ok;
+}
+
+bool    StrTable::load_from_memory(const void* data, size_t size)
+{
+    clear();
+    const StrTableBlobHeader* header = (const StrTableBlobHeader*)data;
+    if (data == NULL || size < sizeof(StrTableBlobHeader) || ((size_t)data % sizeof(unsigned int)) != 0)
+        return false;
+    if (memcmp(header->Magic, STR_TABLE_MAGIC, sizeof(header->Magic)) != 0 || header->ByteOrderMark != STR_TABLE_BYTE_ORDER_MARK || header->Count > 0x7FFFFFFF)
+        return false;
+    size_t payload_size = size - sizeof(StrTableBlobHeader);
+    if (header->Count > payload_size / sizeof(Entry))
+        return false;
+    size_t entries_size = (size_t)header->Count * sizeof(Entry);
+    if (header->CharsSize > payload_size - entries_size)
+        return false;
+    Entries = (Entry*)(void*)(header + 1);
+    Chars = (char*)Entries + entries_size;
+    if (header->CharsSize > 0 && Chars[header->CharsSize - 1] != 0)
+    {
+        Entries = NULL;
+        Chars = NULL;
+        return false;
+    }
+    EntriesCount = (int)header->Count;
+    CharsSize = (size_t)header->CharsSize;
+    Owned = false;
+    return true;
+}
+
+bool    StrTable::load(const char* path)
+{
+    clear();
+    StrMappedFile file;
+    if (!StrMapFile(path, 0, &file))
+        return false;
+    if (!load_from_memory(file.Data, file.Size))
+    {
+        if (file.Base)
+            StrUnmapFile(file.Base, file.BaseSize);
+        return false;
+    }
+    MappedBase = file.Base;
+    MappedSize = file.BaseSize;
+    return true;
+}
+
+#endif // #if STR_ENABLE_TABLE
+
+//-------------------------------------------------------------------------
+// Log buffer
+//-------------------------------------------------------------------------
+
+#if STR_ENABLE_LOG_BUFFER
+
+#include <atomic>
+#include <thread>       // for std::this_thread::yield
+#ifndef _WIN32
+#include <sys/uio.h>    // for writev
+#include <limits.h>     // for IOV_MAX
+#include <errno.h>
+#endif
+
+// Each record starts on an 8 bytes boundary with this header, followed by the text and a zero terminator.
+// 'Tag' is derived from the position of the record and stored last: the consumer compares it with the tag expected at its
+// read position, so a record is never read before it is complete, nor mistaken for a record of the previous lap.
+// Consumed bytes are zeroed before being handed back to producers, so stale text can't be mistaken for a tag either.
+struct StrLogRecordHeader
+{
+    std::atomic<unsigned int>   Tag;
+    unsigned int                Length;         // Text length, or size of skipped bytes after the header with STR_LOG_RECORD_PADDING
+};
+
+#define STR_LOG_RECORD_PADDING      0x80000000u // Unused bytes: the unused end of an overestimated reservation, or a reservation crossing the end of the ring
+#define STR_LOG_LENGTH_HINT_SLACK   32          // Extra room reserved over the length of the last record formatted by the same thread
+
+struct StrLogBufferData
+{
+    char*                   Buf;
+    unsigned int            Size;               // Power of two
+    unsigned int            MaxLength;          // Longer records are truncated
+    char                    Pad0[64];
+    std::atomic<unsigned long long> Head;       // Next position to reserve, only ever incremented
+    char                    Pad1[64];
+    std::atomic<unsigned long long> Tail;       // Position up to which the consumer is done, ring bytes before it can be reused
+    char                    Pad2[64];
+};
+
+static thread_local unsigned int    GStrLogLengthHint = 64;
+
+static inline unsigned int  StrLogTag(unsigned long long pos)          { return (unsigned int)(pos >> 3) | 0x80000000u; }  // Never 0
+static inline unsigned int  StrLogSlotSize(unsigned int text_len)      { return (unsigned int)((sizeof(StrLogRecordHeader) + text_len + 1 + 7) & ~(size_t)7); }
+
+static inline StrLogRecordHeader* StrLogHeaderAt(StrLogBufferData* d, unsigned long long pos)
+{
+    return (StrLogRecordHeader*)(void*)(d->Buf + (pos & (d->Size - 1)));
+}
+
+// Mark [pos, pos + slot_size) as skipped. May cross the end of the ring, the header itself never does.
+static void StrLogPublishPadding(StrLogBufferData* d, unsigned long long pos, unsigned int slot_size)
+{
+    StrLogRecordHeader* hdr = StrLogHeaderAt(d, pos);
+    hdr->Length = (slot_size - (unsigned int)sizeof(StrLogRecordHeader)) | STR_LOG_RECORD_PADDING;
+    hdr->Tag.store(StrLogTag(pos), std::memory_order_release);
+}
+
+// Publish a record of 'text_len' characters, already written, in a reservation of 'slot_size' bytes
+static void StrLogPublish(StrLogBufferData* d, unsigned long long pos, unsigned int slot_size, unsigned int text_len)
+{
+    unsigned int used = StrLogSlotSize(text_len);
+    if (used < slot_size)
+        StrLogPublishPadding(d, pos + used, slot_size - used);
+    StrLogRecordHeader* hdr = StrLogHeaderAt(d, pos);
+    hdr->Length = text_len;
+    hdr->Tag.store(StrLogTag(pos), std::memory_order_release);
+}
+
+// Reserve 'slot_size' contiguous bytes, waiting for the consumer if the ring is full. Return text pointer.
+static char* StrLogReserve(StrLogBufferData* d, unsigned int slot_size, unsigned long long* out_pos)
+{
+    for (;;)
+    {
+        unsigned long long pos = d->Head.fetch_add(slot_size, std::memory_order_relaxed);
+        for (int spin = 0; pos + slot_size - d->Tail.load(std::memory_order_acquire) > d->Size; spin++)
+            if (spin >= 64)
+                std::this_thread::yield();
+        if ((pos & (d->Size - 1)) + slot_size <= d->Size)
+        {
+            *out_pos = pos;
+            return (char*)(StrLogHeaderAt(d, pos) + 1);
+        }
+        // Crossing the end of the ring: skip and reserve again from the start
+        StrLogPublishPadding(d, pos, slot_size);
+    }
+}
+
+StrLogBuffer::StrLogBuffer(int size)
+{
+    unsigned int ring_size = 4096;
+    while (ring_size < (unsigned int)size && ring_size < 0x40000000u)
+        ring_size <<= 1;
+    Data = new (STR_MEMALLOC(sizeof(StrLogBufferData))) StrLogBufferData();
+    Data->Buf = (char*)STR_MEMALLOC(ring_size);
+    memset(Data->Buf, 0, ring_size);
+    Data->Size = ring_size;
+    Data->MaxLength = ring_size / 4 - (unsigned int)sizeof(StrLogRecordHeader) - 1;
+    Data->Head.store(0);
+    Data->Tail.store(0);
+}
+
+StrLogBuffer::~StrLogBuffer()
+{
+    STR_MEMFREE(Data->Buf);
+    Data->~StrLogBufferData();
+    STR_MEMFREE(Data);
+}
+
+int     StrLogBuffer::size() const
+{
+    return (int)Data->Size;
+}
+
+void    StrLogBuffer::append(const char* s, const char* s_end)
+{
+    unsigned int len = (unsigned int)(s_end ? (size_t)(s_end - s) : strlen(s));
+    if (len > Data->MaxLength)
+        len = Data->MaxLength;
+    unsigned int slot_size = StrLogSlotSize(len);
+    unsigned long long pos;
+    char* dst = StrLogReserve(Data, slot_size, &pos);
+    memcpy(dst, s, len);
+    dst[len] = 0;
+    StrLogPublish(Data, pos, slot_size, len);
+}
+
+void    StrLogBuffer::appendf(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    appendfv(fmt, args);
+    va_end(args);
+}
+
+// Reserve based on the length of the last record of this thread and format in place.
+// If that was too small the reservation is skipped and we format again in an exact reservation (same as Str::appendfv_from() growing its buffer).
+void    StrLogBuffer::appendfv(const char* fmt, va_list args)
+{
+    va_list args2;
+    va_copy(args2, args);
+
+    StrLogBufferData* d = Data;
+    unsigned long long pos;
+#ifdef _MSC_VER
+    // MSVC returns -1 on overflow, measure first
+    int len = vsnprintf(NULL, 0, fmt, args);
+    if (len < 0)
+        len = 0;
+    if ((unsigned int)len > d->MaxLength)
+        len = (int)d->MaxLength;
+    unsigned int slot_size = StrLogSlotSize((unsigned int)len);
+    char* dst = StrLogReserve(d, slot_size, &pos);
+    vsnprintf(dst, (size_t)len + 1, fmt, args2);
+#else
+    unsigned int hint = GStrLogLengthHint + STR_LOG_LENGTH_HINT_SLACK;
+    if (hint > d->MaxLength)
+        hint = d->MaxLength;
+    unsigned int slot_size = StrLogSlotSize(hint);
+    char* dst = StrLogReserve(d, slot_size, &pos);
+    int len = vsnprintf(dst, (size_t)hint + 1, fmt, args);
+    if (len < 0)
+        len = 0;
+    if ((unsigned int)len > hint)
+    {
+        StrLogPublishPadding(d, pos, slot_size);
+        if ((unsigned int)len > d->MaxLength)
+            len = (int)d->MaxLength;
+        slot_size = StrLogSlotSize((unsigned int)len);
+        dst = StrLogReserve(d, slot_size, &pos);
+        vsnprintf(dst, (size_t)len + 1, fmt, args2);
+    }
+#endif
+    dst[len] = 0;
+    StrLogPublish(d, pos, slot_size, (unsigned int)len);
+    GStrLogLengthHint = (unsigned int)len;
+    va_end(args2);
+}
+
+// Collect up to 'max_records' consecutive published records from the consumer position. Return end position.
+static unsigned long long StrLogCollect(StrLogBufferData* d, StrView* out_records, int max_records, int* out_count)
+{
+    unsigned long long pos = d->Tail.load(std::memory_order_relaxed);
+    int count = 0;
+    while (count < max_records)
+    {
+        StrLogRecordHeader* hdr = StrLogHeaderAt(d, pos);
+        if (hdr->Tag.load(std::memory_order_acquire) != StrLogTag(pos))
+            break;
+        unsigned int len = hdr->Length;
+        if (len & STR_LOG_RECORD_PADDING)
+        {
+            pos += sizeof(StrLogRecordHeader) + (len & ~STR_LOG_RECORD_PADDING);
+            continue;
+        }
+        const char* text = (const char*)(hdr + 1);
+        if (len > 0)
+            out_records[count++] = StrView(text, text + len);
+        pos += StrLogSlotSize(len);
+    }
+    *out_count = count;
+    return pos;
+}
+
+// Zero consumed bytes (so no stale tag can match later) and hand them back to producers
+static void StrLogRelease(StrLogBufferData* d, unsigned long long end_pos)
+{
+    unsigned long long pos = d->Tail.load(std::memory_order_relaxed);
+    if (pos == end_pos)
+        return;
+    unsigned int begin = (unsigned int)(pos & (d->Size - 1));
+    unsigned long long size = end_pos - pos;
+    if (begin + size <= d->Size)
+    {
+        memset(d->Buf + begin, 0, (size_t)size);
+    }
+    else
+    {
+        memset(d->Buf + begin, 0, d->Size - begin);
+        memset(d->Buf, 0, (size_t)(size - (d->Size - begin)));
+    }
+    d->Tail.store(end_pos, std::memory_order_release);
+}
+
+#define STR_LOG_DRAIN_BATCH     64
+
+int     StrLogBuffer::drain(Str& out)
+{
+    StrView records[STR_LOG_DRAIN_BATCH];
+    int total = 0;
+    int idx = out.length();
+    for (;;)
+    {
+        int count;
+        unsigned long long end_pos = StrLogCollect(Data, records, STR_LOG_DRAIN_BATCH, &count);
+        for (int n = 0; n < count; n++)
+            idx += out.append_from(idx, records[n]);
+        StrLogRelease(Data, end_pos);
+        total += count;
+        if (count < STR_LOG_DRAIN_BATCH)
+            return total;
+    }
+}
+
+int     StrLogBuffer::drain(int fd)
+{
+    StrView records[STR_LOG_DRAIN_BATCH];
+    int total = 0;
+    for (;;)
+    {
+        int count;
+        unsigned long long end_pos = StrLogCollect(Data, records, STR_LOG_DRAIN_BATCH, &count);
+#ifdef _WIN32
+        for (int n = 0; n < count; n++)
+            for (const char* p = records[n].Begin; p < records[n].End; )
+            {
+                int w = _write(fd, p, (unsigned int)(records[n].End - p));
+                if (w <= 0)
+                    return -1;
+                p += w;
+            }
+#else
+        // Write the whole batch, resuming after partial writes
+        struct iovec iov[STR_LOG_DRAIN_BATCH];
+        for (int n = 0; n < count; n++)
+        {
+            iov[n].iov_base = (void*)records[n].Begin;
+            iov[n].iov_len = (size_t)(records[n].End - records[n].Begin);
+        }
+        const int IOV_BATCH = IOV_MAX < STR_LOG_DRAIN_BATCH ? IOV_MAX : STR_LOG_DRAIN_BATCH;
+        for (struct iovec* it = iov; it < iov + count; )
+        {
+            int iov_count = (int)(iov + count - it) < IOV_BATCH ? (int)(iov + count - it) : IOV_BATCH;
+            ssize_t w = writev(fd, it, iov_count);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                return -1;
+            for (size_t remaining = (size_t)w; remaining > 0; )
+            {
+                if (remaining < it->iov_len)
+                {
+                    it->iov_base = (char*)it->iov_base + remaining;
+                    it->iov_len -= remaining;
+                    break;
+                }
+                remaining -= it->iov_len;
+                it++;
+            }
+        }
+#endif
+        StrLogRelease(Data, end_pos);
+        total += count;
+        if (count < STR_LOG_DRAIN_BATCH)
+            return total;
+    }
+}
+
+#endif // #if STR_ENABLE_LOG_BUFFER
+
+//-------------------------------------------------------------------------
+// Scratch ring
+//-------------------------------------------------------------------------
+
+struct StrScratchRing
+{
+    Str                 Buffers[STR_SCRATCH_RING_SIZE];
+#if STR_SCRATCH_CHECK
+    unsigned int        Generations[STR_SCRATCH_RING_SIZE];
+#endif
+    int                 Next;
+    StrScratchRing() : Next(0) {
+#if STR_SCRATCH_CHECK
+        memset(Generations, 0, sizeof(Generations));
+#endif
+    }
+};
+
+static thread_local StrScratchRing  GStrScratchRing;
+
+Str*    StrScratch::acquire(StrScratchRef* out_ref)
+{
+    StrScratchRing& ring = GStrScratchRing;
+    int slot = ring.Next;
+    ring.Next = (slot + 1 == STR_SCRATCH_RING_SIZE) ? 0 : slot + 1;
+    Str* buf = &ring.Buffers[slot];
+    if (buf->capacity() > STR_SCRATCH_KEEP_CAPACITY)
+        buf->clear();
+#if STR_SCRATCH_CHECK
+    out_ref->Generation = ++ring.Generations[slot];
+    out_ref->SlotGeneration = &ring.Generations[slot];
+#else
+    (void)out_ref;
+#endif
+    return buf;
+}
+
+StrScratchRef   StrScratch::fv(const char* fmt, va_list args)
+{
+    StrScratchRef ref;
+    Str* buf = acquire(&ref);
+    ref.Length = buf->setfv(fmt, args);
+    ref.Data = buf->c_str();
+    return ref;
+}
+
+StrScratchRef   StrScratch::f(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    StrScratchRef ref = fv(fmt, args);
+    va_end(args);
+    return ref;
+}
+
+StrScratchRef   StrScratch::fmtv(const char* fmt, const StrFmtArg* args, int args_count)
+{
+    StrScratchRef ref;
+    Str* buf = acquire(&ref);
+    ref.Length = buf->fmt_appendv_from(0, fmt, args, args_count);
+    ref.Data = buf->c_str();
+    return ref;
+}
+
+StrScratchRef   StrScratch::joinv(const StrView& sep, const StrView* pieces, int pieces_count)
+{
+    StrScratchRef ref;
+    Str* buf = acquire(&ref);
+    ref.Length = buf->joinv_from(0, sep, pieces, pieces_count);
+    ref.Data = buf->c_str();
+    return ref;
+}
+
 #endif // #define STR_IMPLEMENTATION
 
 //-------------------------------------------------------------------------
@@ -0,0 +1,608 @@
+// Benchmarks for Str.h
+// Compare Str, StrXXX local buffer types and std::string on core operations, over string sizes from 4 bytes to 1 MB.
+//
+// Usage: str_bench [--csv | --json] [--filter <substring>] [--quick]
+//   --csv, --json      Machine-readable output (default is a human readable table)
+//   --filter <str>     Only run cases whose name contains <str>
+//   --quick            Shorter measurements, for smoke testing
+//
+// Columns:
+//   ns/op              Time per operation
+//   allocs/op          Calls to STR_MEMALLOC (Str) or operator new (std::string) per operation
+//   alloc_bytes/op     Bytes requested from those allocations per operation
+//   bytes/op           Bytes of string data written or compared by one operation (payload, not counting reallocation copies)
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <strings.h>      // for strncasecmp
+#endif
+
+// Allocation counters, fed by STR_MEMALLOC, STR_MEMREALLOC and by the global operator new (for std::string)
+// With STR_USE_POOL_ALLOCATOR=1 the hooks wrap the built-in pool instead of malloc().
+static size_t GAllocCount = 0;
+static size_t GAllocBytes = 0;
+static void* BenchAlloc(size_t size);
+static void* BenchRealloc(void* p, size_t size);
+static void  BenchFree(void* p);
+
+#define STR_MEMALLOC    BenchAlloc
+#define STR_MEMFREE     BenchFree
+#define STR_MEMREALLOC  BenchRealloc
+#define STR_ENABLE_HASH_MAP 1
+#define STR_ENABLE_TABLE 1
+#define STR_ENABLE_LOG_BUFFER 1
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+#if STR_USE_POOL_ALLOCATOR
+#define BENCH_ALLOCATOR_NAME    "pool"
+static void* BenchAlloc(size_t size) { GAllocCount++; GAllocBytes += size; return StrPoolAlloc(size); }
+static void* BenchRealloc(void* p, size_t size) { GAllocCount++; GAllocBytes += size; return StrPoolRealloc(p, size); }
+static void  BenchFree(void* p) { StrPoolFree(p); }
+#else
+#define BENCH_ALLOCATOR_NAME    "malloc"
+static void* BenchAlloc(size_t size) { GAllocCount++; GAllocBytes += size; return malloc(size); }
+static void* BenchRealloc(void* p, size_t size) { GAllocCount++; GAllocBytes += size; return realloc(p, size); }
+static void  BenchFree(void* p) { free(p); }
+#endif
+
+void* operator new(size_t size)
+{
+    GAllocCount++;
+    GAllocBytes += size;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"  // our operator new uses malloc(), GCC doesn't know that after inlining operator delete
+#endif
+void operator delete(void* p) noexcept              { free(p); }
+void operator delete(void* p, size_t) noexcept      { free(p); }
+
+//-------------------------------------------------------------------------
+// Harness
+//-------------------------------------------------------------------------
+
+enum OutputFormat { OutputFormat_Table, OutputFormat_Csv, OutputFormat_Json };
+
+struct BenchContext
+{
+    OutputFormat        Format = OutputFormat_Table;
+    const char*         Filter = NULL;
+    double              MinSeconds = 0.05;
+    int                 ResultsCount = 0;
+    volatile size_t     Sink = 0;           // Prevent the compiler from optimizing away results
+};
+static BenchContext     GBench;
+
+static const int        GSizes[] = { 4, 16, 64, 256, 1024, 4096, 64 * 1024, 1024 * 1024 };
+static char*            GSource = NULL;     // Random printable characters, zero terminated at any needed position with MakeSource()
+static char*            GSource2 = NULL;    // Same contents as GSource, different buffer
+
+static const char* MakeSource(char* buf, int size)
+{
+    static char saved_chars[2] = { 0, 0 };
+    static int saved_size[2] = { -1, -1 };
+    int n = (buf == GSource) ? 0 : 1;
+    if (saved_size[n] >= 0)
+        buf[saved_size[n]] = saved_chars[n];
+    saved_size[n] = size;
+    saved_chars[n] = buf[size];
+    buf[size] = 0;
+    return buf;
+}
+
+static void OutputResult(const char* case_name, const char* type_name, int size, double ns, double allocs, double alloc_bytes, double bytes)
+{
+    switch (GBench.Format)
+    {
+    case OutputFormat_Table:
+        if (GBench.ResultsCount == 0)
+            printf("%-22s %-12s %8s %12s %10s %15s %10s\n", "case", "type", "size", "ns/op", "allocs/op", "alloc_bytes/op", "bytes/op");
+        printf("%-22s %-12s %8d %12.1f %10.2f %15.1f %10.0f\n", case_name, type_name, size, ns, allocs, alloc_bytes, bytes);
+        break;
+    case OutputFormat_Csv:
+        if (GBench.ResultsCount == 0)
+            printf("case,type,size,ns_per_op,allocs_per_op,alloc_bytes_per_op,bytes_per_op\n");
+        printf("%s,%s,%d,%.3f,%.4f,%.2f,%.0f\n", case_name, type_name, size, ns, allocs, alloc_bytes, bytes);
+        break;
+    case OutputFormat_Json:
+        printf("%s\n  { \"case\": \"%s\", \"type\": \"%s\", \"size\": %d, \"ns_per_op\": %.3f, \"allocs_per_op\": %.4f, \"alloc_bytes_per_op\": %.2f, \"bytes_per_op\": %.0f }",
+            GBench.ResultsCount == 0 ? "[" : ",", case_name, type_name, size, ns, allocs, alloc_bytes, bytes);
+        break;
+    }
+    GBench.ResultsCount++;
+    fflush(stdout);
+}
+
+// Run 'func(iterations)' with growing iteration counts until it takes long enough to be measured
+template<typename FUNC>
+static void Run(const char* case_name, const char* type_name, int size, double bytes_per_op, FUNC func)
+{
+    if (GBench.Filter && strstr(case_name, GBench.Filter) == NULL)
+        return;
+    func(1); // Warm up
+    for (long long iterations = 1; ; iterations *= 2)
+    {
+        size_t alloc_count = GAllocCount;
+        size_t alloc_bytes = GAllocBytes;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        func(iterations);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(t1 - t0).count();
+        if (seconds >= GBench.MinSeconds || iterations >= (1LL << 40))
+        {
+            double n = (double)iterations;
+            OutputResult(case_name, type_name, size, seconds * 1e9 / n, (double)(GAllocCount - alloc_count) / n, (double)(GAllocBytes - alloc_bytes) / n, bytes_per_op);
+            return;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Operations on Str and std::string
+//-------------------------------------------------------------------------
+
+static inline void   DoSet(Str& s, const char* src, int len)                { s.set(src, src + len); }
+static inline void   DoSet(std::string& s, const char* src, int len)        { s.assign(src, (size_t)len); }
+static inline void   DoAppend(Str& s, const char* src, int len)             { s.append(src, src + len); }
+static inline void   DoAppend(std::string& s, const char* src, int len)     { s.append(src, (size_t)len); }
+static inline void   DoClear(Str& s)                                        { s.clear(); }
+static inline void   DoClear(std::string& s)                                { s.clear(); }
+static inline void   DoReserve(Str& s, int cap)                             { s.reserve(cap); }
+static inline void   DoReserve(std::string& s, int cap)                     { s.reserve((size_t)cap); }
+static inline void   DoShrink(Str& s)                                       { s.shrink_to_fit(); }
+static inline void   DoShrink(std::string& s)                               { s.shrink_to_fit(); }
+static inline size_t DoLength(const Str& s)                                 { return (size_t)s.length(); }
+static inline size_t DoLength(const std::string& s)                         { return s.length(); }
+static inline const char* DoCStr(const Str& s)                              { return s.c_str(); }
+static inline const char* DoCStr(const std::string& s)                      { return s.c_str(); }
+
+static const int    PIECE_LEN = 8;          // Size of pieces for append loops
+
+// Cases common to Str types and std::string
+template<typename T>
+static void BenchCommon(const char* type_name)
+{
+    for (int size : GSizes)
+    {
+        const char* src = MakeSource(GSource, size);
+        const char* src2 = MakeSource(GSource2, size);
+
+        Run("set", type_name, size, size, [&](long long n) { T s; for (long long i = 0; i < n; i++) { DoSet(s, src, size); GBench.Sink += DoLength(s); } });
+        Run("construct", type_name, size, size, [&](long long n) { for (long long i = 0; i < n; i++) { T s(src); GBench.Sink += DoLength(s); } });
+        T copy_src(src);
+        Run("copy", type_name, size, size, [&](long long n) { for (long long i = 0; i < n; i++) { T s(copy_src); GBench.Sink += DoLength(s); } });
+        Run("append_loop", type_name, size, size, [&](long long n)
+        {
+            for (long long i = 0; i < n; i++)
+            {
+                T s;
+                for (int len = 0; len < size; len += PIECE_LEN)
+                    DoAppend(s, src + len, (size - len) < PIECE_LEN ? (size - len) : PIECE_LEN);
+                GBench.Sink += DoLength(s);
+            }
+        });
+        Run("reserve_shrink", type_name, size, size / 2, [&](long long n)
+        {
+            for (long long i = 0; i < n; i++)
+            {
+                T s;
+                DoReserve(s, size);
+                DoSet(s, src, size / 2);
+                DoShrink(s);
+                GBench.Sink += DoLength(s);
+            }
+        });
+        T a(src), b(src2);
+        Run("equals", type_name, size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += (a == b) ? 1 : 0; });
+        GBench.Sink += (size_t)DoCStr(a)[0];
+    }
+}
+
+// Cases only available on Str types
+template<typename T>
+static void BenchStr(const char* type_name)
+{
+    for (int size : GSizes)
+    {
+        const char* src = MakeSource(GSource, size);
+
+        Run("set_ref", type_name, size, 0, [&](long long n) { T s; for (long long i = 0; i < n; i++) { s.set_ref(src); GBench.Sink += (size_t)s.c_str()[0]; } });
+        Run("reserve_short", type_name, size, 10, [&](long long n) { for (long long i = 0; i < n; i++) { T s("0123456789"); s.reserve(size); GBench.Sink += (size_t)s.c_str()[0]; } });
+        Run("setf", type_name, size, size, [&](long long n) { T s; for (long long i = 0; i < n; i++) { s.setf("%s", src); GBench.Sink += (size_t)s.c_str()[0]; } });
+        if (sizeof(T) > sizeof(Str))
+            Run("setf_nogrow", type_name, size, size, [&](long long n) { T s; for (long long i = 0; i < n; i++) { s.setf_nogrow("%s", src); GBench.Sink += (size_t)s.c_str()[0]; } });
+        Run("appendf_loop", type_name, size, size, [&](long long n)
+        {
+            char piece[PIECE_LEN + 1];
+            memcpy(piece, src, PIECE_LEN);
+            piece[PIECE_LEN] = 0;
+            for (long long i = 0; i < n; i++)
+            {
+                T s;
+                for (int len = 0; len < size; len += PIECE_LEN)
+                    s.appendf("%s", piece);
+                GBench.Sink += (size_t)s.length();
+            }
+        });
+        Run("append_from_loop", type_name, size, size, [&](long long n)
+        {
+            for (long long i = 0; i < n; i++)
+            {
+                T s;
+                int idx = 0;
+                for (int len = 0; len < size; len += PIECE_LEN)
+                    idx += s.append_from(idx, src + len, src + len + ((size - len) < PIECE_LEN ? (size - len) : PIECE_LEN));
+                GBench.Sink += (size_t)idx;
+            }
+        });
+    }
+}
+
+// Allocator churn: heap strings of mixed sizes freed and reallocated by set()/setf(), as in code building short-lived names and paths.
+// Type column is "Str (malloc)" or "Str (pool)": build a second time with -DSTR_BENCH_DEFINES=STR_USE_POOL_ALLOCATOR=1 to compare.
+static void BenchChurn()
+{
+    static const int churn_sizes[] = { 24, 40, 72, 100, 200, 500, 1000, 3000 };
+    const int slots_count = 64;
+    const char* type_name = "Str (" BENCH_ALLOCATOR_NAME ")";
+    const char* src = MakeSource(GSource, 4096);
+    char fmt_piece[16 + 1];
+    memcpy(fmt_piece, src, 16);
+    fmt_piece[16] = 0;
+    Run("churn_set", type_name, 0, 0, [&](long long n)
+    {
+        Str slots[slots_count];
+        for (long long i = 0; i < n; i++)
+        {
+            Str& s = slots[i & (slots_count - 1)];
+            int size = churn_sizes[(i * 7) & 7];
+            s.clear();
+            s.set(src, src + size);
+            GBench.Sink += (size_t)s.c_str()[0];
+        }
+    });
+    Run("churn_setf", type_name, 0, 0, [&](long long n)
+    {
+        Str slots[slots_count];
+        for (long long i = 0; i < n; i++)
+        {
+            Str& s = slots[i & (slots_count - 1)];
+            int size = churn_sizes[(i * 7) & 7];
+            s.clear();
+            s.setf("%.*s/%s_%d.tmp", size, src, fmt_piece, (int)i);
+            GBench.Sink += (size_t)s.c_str()[0];
+        }
+    });
+#if STR_USE_POOL_ALLOCATOR
+    StrPoolStats stats;
+    StrPoolGetStats(&stats);
+    if (GBench.Format == OutputFormat_Table)
+        printf("(pool hit rate %.1f%%)\n", stats.GetHitRate() * 100.0f);
+#endif
+}
+
+// Numbers: vsnprintf() vs direct formatting
+static void BenchNumbers()
+{
+    Run("appendf_int", "Str64", 0, 0, [&](long long n) { Str64 s; for (long long i = 0; i < n; i++) { s.clear(); s.appendf("%d", (int)(i * 7919)); GBench.Sink += (size_t)s.length(); } });
+    Run("append_int", "Str64", 0, 0, [&](long long n) { Str64 s; for (long long i = 0; i < n; i++) { s.clear(); s.append_int((int)(i * 7919)); GBench.Sink += (size_t)s.length(); } });
+    Run("appendf_float", "Str64", 0, 0, [&](long long n) { Str64 s; for (long long i = 0; i < n; i++) { s.clear(); s.appendf("%.3f", (double)i * 0.37); GBench.Sink += (size_t)s.length(); } });
+    Run("append_float", "Str64", 0, 0, [&](long long n) { Str64 s; for (long long i = 0; i < n; i++) { s.clear(); s.append_float((double)i * 0.37, 3); GBench.Sink += (size_t)s.length(); } });
+}
+
+// Formatting: vsnprintf() vs type-safe fmt_append()
+static void BenchFormat()
+{
+    const char* folder = "data/textures";
+    Str64 filename("grass_diffuse");
+    Run("fmt_append_int", "Str64", 0, 0, [&](long long n) { Str64 s; for (long long i = 0; i < n; i++) { s.clear(); s.fmt_append("{}", (int)(i * 7919)); GBench.Sink += (size_t)s.length(); } });
+    Run("appendf_mixed", "Str64", 0, 0, [&](long long n) { Str64 s; for (long long i = 0; i < n; i++) { s.clear(); s.appendf("%s/%s_%d.tmp %.2f", folder, filename.c_str(), (int)i, (double)i * 0.37); GBench.Sink += (size_t)s.length(); } });
+    Run("fmt_append_mixed", "Str64", 0, 0, [&](long long n) { Str64 s; for (long long i = 0; i < n; i++) { s.clear(); s.fmt_append("{}/{}_{}.tmp {:.2}", folder, filename, (int)i, (double)i * 0.37); GBench.Sink += (size_t)s.length(); } });
+    Run("appendf_mixed", "Str", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) { Str s; s.appendf("%s/%s_%d.tmp %.2f", folder, filename.c_str(), (int)i, (double)i * 0.37); GBench.Sink += (size_t)s.length(); } });
+    Run("fmt_append_mixed", "Str", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) { Str s; s.fmt_append("{}/{}_{}.tmp {:.2}", folder, filename, (int)i, (double)i * 0.37); GBench.Sink += (size_t)s.length(); } });
+
+    // Path building and joining: one append() per piece vs concat()/join() reserving once
+    const char* columns[] = { "id", "name", "created_at", "updated_at", "owner_id", "flags", "payload", "checksum" };
+    Run("append_path", "Str", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) { Str s; s.append(folder); s.append("/"); s.append(filename); s.append(".tmp"); GBench.Sink += (size_t)s.length(); } });
+    Run("concat_path", "Str", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) { Str s; s.concat(folder, "/", filename, ".tmp"); GBench.Sink += (size_t)s.length(); } });
+    Run("append_list", "Str", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) { Str s; for (int c = 0; c < 8; c++) { if (c) s.append(", "); s.append(columns[c]); } GBench.Sink += (size_t)s.length(); } });
+    Run("join_list", "Str", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) { Str s; s.join(", ", columns, columns + 8); GBench.Sink += (size_t)s.length(); } });
+
+    // Temporaries: StrXXXf on the stack vs the scratch ring
+    Run("temp_path", "Str256f", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += strlen(Str256f("%s/%s_%d.tmp", folder, filename.c_str(), (int)i).c_str()); });
+    Run("temp_path", "StrScratch", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += strlen(StrScratch::f("%s/%s_%d.tmp", folder, filename.c_str(), (int)i).c_str()); });
+    Run("temp_path_fmt", "StrScratch", 0, 0, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += strlen(StrScratch::fmt("{}/{}_{}.tmp", folder, filename, (int)i).c_str()); });
+}
+
+// Search: Str::find() vs strstr() and memmem(), needle at the end of the haystack
+static void BenchSearch()
+{
+    const char* needle = "needle!!";
+    for (int size : GSizes)
+    {
+        if (size < 16)
+            continue;
+        Str haystack(MakeSource(GSource, size));
+        memcpy(haystack.c_str() + size - 8, needle, 8);
+        Run("find", "Str", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += (size_t)haystack.find(needle); });
+        Run("find_strstr", "const char*", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += (size_t)strstr(haystack.c_str(), needle); });
+#if defined(__GLIBC__)
+        Run("find_memmem", "const char*", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += (size_t)memmem(haystack.c_str(), (size_t)size, needle, 8); });
+#endif
+    }
+}
+
+// Case conversion and UTF-8 kernels vs byte-at-a-time loops. bytes/op divided by ns/op gives GB/s.
+static void BenchText()
+{
+    for (int size : GSizes)
+    {
+        if (size < 1024)
+            continue;
+        Str s(MakeSource(GSource, size));
+        Str s2(s);
+        s2.to_upper();
+        Run("to_lower", "Str", size, size, [&](long long n) { for (long long i = 0; i < n; i++) { s.to_upper(); s.to_lower(); GBench.Sink += (size_t)s[0]; } });
+        Run("to_lower", "tolower() loop", size, size, [&](long long n) { for (long long i = 0; i < n; i++) { char* p = s.c_str(); for (int c = 0; c < size; c++) p[c] = (char)toupper(p[c]); for (int c = 0; c < size; c++) p[c] = (char)tolower(p[c]); GBench.Sink += (size_t)p[0]; } });
+        Run("equals_ignore_case", "Str", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += s.equals_ignore_case(s2) ? 1 : 0; });
+#if defined(__GLIBC__) || defined(__APPLE__)
+        Run("equals_ignore_case", "strncasecmp", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += strncasecmp(s.c_str(), s2.c_str(), (size_t)size) == 0 ? 1 : 0; });
+#endif
+        Run("is_valid_utf8", "Str", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += s.is_valid_utf8() ? 1 : 0; });
+        Run("utf8_length", "Str", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += (size_t)s.utf8_length(); });
+        Run("utf8_length", "byte loop", size, size, [&](long long n) { for (long long i = 0; i < n; i++) { const char* p = s.c_str(); int count = 0; for (int c = 0; c < size; c++) count += ((p[c] & 0xC0) != 0x80) ? 1 : 0; GBench.Sink += (size_t)count; } });
+    }
+}
+
+// 1M short strings: StrTable vs std::vector<Str>, building from a newline-separated buffer and iterating
+static void BenchTable()
+{
+    const int count = 1000000;
+    Str text;
+    int text_len = 0;
+    for (int n = 0; n < count; n++)
+        text_len += text.fmt_append_from(text_len, (n & 1) ? StrFmtRuntime("key_{}\n") : StrFmtRuntime("some/longer/path/key_{}\n"), (unsigned int)n * 7919u);
+    Run("table_build_1M", "StrTable", count, text.length(), [&](long long n) { for (long long i = 0; i < n; i++) { StrTable table; table.append_lines(text); GBench.Sink += (size_t)table.size(); } });
+    Run("table_build_1M", "std::vector<Str>", count, text.length(), [&](long long n) { for (long long i = 0; i < n; i++) { std::vector<Str> table; for (StrView line : StrSplit(text, '\n')) if (!line.empty()) table.push_back(Str()), table.back().set(line); GBench.Sink += table.size(); } });
+    StrTable table;
+    table.append_lines(text);
+    std::vector<Str> vec;
+    for (StrView line : StrSplit(text, '\n'))
+        if (!line.empty())
+            vec.push_back(Str()), vec.back().set(line);
+    Run("table_iterate_1M", "StrTable", count, 0, [&](long long n) { for (long long i = 0; i < n; i++) for (int k = 0; k < table.size(); k++) GBench.Sink += (size_t)table[k][0]; });
+    Run("table_iterate_1M", "std::vector<Str>", count, 0, [&](long long n) { for (long long i = 0; i < n; i++) for (const Str& s : vec) GBench.Sink += (size_t)s.c_str()[0]; });
+}
+
+// Hashing: StrHash() vs std::hash<std::string>
+// Hash map with 1M keys: StrHashMap<int> vs std::unordered_map<std::string, int>, looking up by const char* as parsers typically do
+static void BenchHash()
+{
+    for (int size : GSizes)
+    {
+        Str s(MakeSource(GSource, size));
+        std::string ss(s.c_str());
+        Run("hash", "Str", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += (size_t)s.hash(); });
+        Run("hash", "std::string", size, size, [&](long long n) { for (long long i = 0; i < n; i++) GBench.Sink += std::hash<std::string>()(ss); });
+    }
+
+    const int keys_count = 1000000;
+    char* keys_buf = (char*)malloc((size_t)keys_count * 32);
+    const char** keys = (const char**)malloc(sizeof(const char*) * keys_count);
+    for (int n = 0; n < keys_count; n++)
+    {
+        keys[n] = keys_buf + n * 32;
+        snprintf(keys_buf + n * 32, 32, (n & 1) ? "key_%u" : "some/longer/path/key_%u", (unsigned int)n * 7919u);
+    }
+    int lookup_n = 0;
+    Run("map_build_1M", "StrHashMap", keys_count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { StrHashMap<int> map; for (int k = 0; k < keys_count; k++) map[keys[k]] = k; GBench.Sink += (size_t)map.size(); } });
+    Run("map_build_1M", "std::unordered_map", keys_count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { std::unordered_map<std::string, int> map; for (int k = 0; k < keys_count; k++) map[keys[k]] = k; GBench.Sink += map.size(); } });
+    {
+        StrHashMap<int> map;
+        for (int k = 0; k < keys_count; k++)
+            map[keys[k]] = k;
+        Run("map_find_1M", "StrHashMap", keys_count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { GBench.Sink += (size_t)*map.find(keys[lookup_n]); lookup_n = (lookup_n + 7) % keys_count; } });
+        Run("map_find_miss_1M", "StrHashMap", keys_count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { GBench.Sink += (size_t)(map.find(keys[lookup_n] + 1) != NULL); lookup_n = (lookup_n + 7) % keys_count; } });
+    }
+    {
+        std::unordered_map<std::string, int> map;
+        for (int k = 0; k < keys_count; k++)
+            map[keys[k]] = k;
+        Run("map_find_1M", "std::unordered_map", keys_count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { GBench.Sink += (size_t)map.find(keys[lookup_n])->second; lookup_n = (lookup_n + 7) % keys_count; } });
+        Run("map_find_miss_1M", "std::unordered_map", keys_count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { GBench.Sink += (size_t)(map.find(keys[lookup_n] + 1) != map.end()); lookup_n = (lookup_n + 7) % keys_count; } });
+    }
+    free(keys);
+    free(keys_buf);
+}
+
+// Sorting 1M strings with shared prefixes: StrSort() vs std::sort() with strcmp(), on arrays of StrRef reset before each sort
+static void BenchSort()
+{
+    const int count = 1000000;
+    StrTable keys;
+    unsigned int seed = 12345;
+    for (int n = 0; n < count; n++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const char* prefixes[] = { "", "assets/", "assets/textures/", "assets/textures/characters/" };
+        keys.append(StrScratch::f("%s%08x", prefixes[(seed >> 8) & 3], seed));
+    }
+    std::vector<StrRef> refs;
+    refs.reserve(count);
+    for (int n = 0; n < count; n++)
+        refs.push_back(StrRef(keys.c_str(n)));
+    auto reset = [&]() { for (int n = 0; n < count; n++) refs[n].set_ref(keys.c_str(n)); };
+    Run("sort_1M", "StrSort", count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { reset(); StrSort(refs.data(), refs.data() + count); GBench.Sink += (size_t)refs[0].c_str()[0]; } });
+    Run("sort_1M", "std::sort", count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { reset(); std::sort(refs.begin(), refs.end(), [](const Str& a, const Str& b) { return strcmp(a.c_str(), b.c_str()) < 0; }); GBench.Sink += (size_t)refs[0].c_str()[0]; } });
+    Run("sort_1M", "reset only", count, 0, [&](long long n) { for (long long i = 0; i < n; i++) { reset(); GBench.Sink += (size_t)refs[0].c_str()[0]; } });
+}
+
+// Escaping and encoding vs per-byte append(char) / appendf("%02x") loops. Text has a quote or a space every ~40 characters.
+static void BenchEncode()
+{
+    for (int size : { 64, 4096, 64 * 1024 })
+    {
+        Str text;
+        for (int n = 0; n < size; n++)
+            text.append_from(n, (n % 41 == 40) ? '"' : (n % 37 == 36) ? ' ' : GSource[n]);
+        StrView src(text.c_str(), text.c_str() + size);
+        Run("json_escape", "Str", size, size, [&](long long n) { Str out; for (long long i = 0; i < n; i++) { out.clear(); GBench.Sink += (size_t)out.append_json_escaped(src); } });
+        Run("json_escape", "append(char) loop", size, size, [&](long long n)
+        {
+            Str out;
+            for (long long i = 0; i < n; i++)
+            {
+                out.clear();
+                int len = 0;
+                for (int c = 0; c < size; c++)
+                {
+                    char ch = src.Begin[c];
+                    if (ch == '"' || ch == '\\')
+                        len += out.append_from(len, '\\');
+                    len += out.append_from(len, ch);
+                }
+                GBench.Sink += (size_t)len;
+            }
+        });
+        Run("url_encode", "Str", size, size, [&](long long n) { Str out; for (long long i = 0; i < n; i++) { out.clear(); GBench.Sink += (size_t)out.append_url_encoded(src); } });
+        Run("hex_encode", "Str", size, size, [&](long long n) { Str out; for (long long i = 0; i < n; i++) { out.clear(); GBench.Sink += (size_t)out.append_hex(src.Begin, size); } });
+        Run("hex_encode", "appendf(%02x) loop", size, size, [&](long long n) { Str out; for (long long i = 0; i < n; i++) { out.clear(); int len = 0; for (int c = 0; c < size; c++) len += out.appendf_from(len, "%02x", (unsigned char)src.Begin[c]); GBench.Sink += (size_t)len; } });
+        Run("base64_encode", "Str", size, size, [&](long long n) { Str out; for (long long i = 0; i < n; i++) { out.clear(); GBench.Sink += (size_t)out.append_base64(src.Begin, size); } });
+        Str encoded;
+        encoded.append_base64(src.Begin, size);
+        Run("base64_decode", "Str", size, size, [&](long long n) { Str out; for (long long i = 0; i < n; i++) { out.clear(); GBench.Sink += (size_t)out.append_base64_decoded(encoded); } });
+    }
+}
+
+// Logging from 1 to 64 threads (size column is the thread count), to the null device:
+// StrLogBuffer drained by a consumer thread vs Str256f appended to a shared Str under a mutex, written out every 64 KB.
+static void BenchLog()
+{
+#ifdef _WIN32
+    FILE* null_file = fopen("NUL", "wb");
+#else
+    FILE* null_file = fopen("/dev/null", "wb");
+#endif
+    if (null_file == NULL)
+        return;
+    setvbuf(null_file, NULL, _IONBF, 0);
+    const int fd = fileno(null_file);
+    const int flush_size = 64 * 1024;
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        Run("log_mt", "StrLogBuffer", threads, 0, [&](long long n)
+        {
+            StrLogBuffer log(1024 * 1024);
+            std::atomic<int> done(0);
+            std::thread consumer([&]() { while (done.load() < threads) if (log.drain(fd) == 0) std::this_thread::yield(); log.drain(fd); });
+            std::vector<std::thread> producers;
+            for (int t = 0; t < threads; t++)
+                producers.emplace_back([&, t]() { for (long long i = t; i < n; i += threads) log.appendf("[%s] worker %d processed item %lld in %.3f ms\n", "bench", t, i, (double)i * 0.001); done++; });
+            for (std::thread& producer : producers)
+                producer.join();
+            consumer.join();
+        });
+        Run("log_mt", "mutex+Str256f", threads, 0, [&](long long n)
+        {
+            std::mutex mutex;
+            Str shared;
+            shared.reserve(flush_size + 256);
+            int shared_len = 0;
+            std::vector<std::thread> producers;
+            for (int t = 0; t < threads; t++)
+                producers.emplace_back([&, t]()
+                {
+                    for (long long i = t; i < n; i += threads)
+                    {
+                        Str256f line("[%s] worker %d processed item %lld in %.3f ms\n", "bench", t, i, (double)i * 0.001);
+                        std::lock_guard<std::mutex> lock(mutex);
+                        shared_len += shared.append_from(shared_len, line.c_str());
+                        if (shared_len >= flush_size)
+                        {
+                            fwrite(shared.c_str(), 1, (size_t)shared_len, null_file);
+                            shared_len = 0;
+                        }
+                    }
+                });
+            for (std::thread& producer : producers)
+                producer.join();
+            fwrite(shared.c_str(), 1, (size_t)shared_len, null_file);
+        });
+    }
+    fclose(null_file);
+}
+
+int main(int argc, char** argv)
+{
+    for (int n = 1; n < argc; n++)
+    {
+        if (strcmp(argv[n], "--csv") == 0)
+            GBench.Format = OutputFormat_Csv;
+        else if (strcmp(argv[n], "--json") == 0)
+            GBench.Format = OutputFormat_Json;
+        else if (strcmp(argv[n], "--quick") == 0)
+            GBench.MinSeconds = 0.002;
+        else if (strcmp(argv[n], "--filter") == 0 && n + 1 < argc)
+            GBench.Filter = argv[++n];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--csv | --json] [--filter <substring>] [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Random printable characters, without '%' so they can be used as format strings
+    const int source_size = GSizes[sizeof(GSizes) / sizeof(GSizes[0]) - 1];
+    GSource = (char*)malloc((size_t)source_size + 1);
+    GSource2 = (char*)malloc((size_t)source_size + 1);
+    unsigned int seed = 12345;
+    for (int n = 0; n < source_size; n++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        GSource[n] = GSource2[n] = (char)('a' + (seed >> 16) % 26);
+    }
+    GSource[source_size] = GSource2[source_size] = 0;
+
+    BenchCommon<Str>("Str");
+    BenchCommon<Str16>("Str16");
+    BenchCommon<Str64>("Str64");
+    BenchCommon<Str256>("Str256");
+    BenchCommon<Str512>("Str512");
+    BenchCommon<std::string>("std::string");
+    BenchStr<Str>("Str");
+    BenchStr<Str16>("Str16");
+    BenchStr<Str64>("Str64");
+    BenchStr<Str256>("Str256");
+    BenchStr<Str512>("Str512");
+    BenchChurn();
+    BenchNumbers();
+    BenchFormat();
+    BenchSearch();
+    BenchText();
+    BenchHash();
+    BenchTable();
+    BenchSort();
+    BenchEncode();
+    BenchLog();
+
+    if (GBench.Format == OutputFormat_Json)
+        printf("%s\n]\n", GBench.ResultsCount ? "" : "[");
+    free(GSource);
+    free(GSource2);
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Test: appending N pieces to a string reallocates O(log N) times (STR_GROW_CAPACITY), reserve_exact() sizes tightly.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Count every call reaching the allocator
+static int GAllocCount = 0;
+static void* TestAlloc(size_t size) { GAllocCount++; return malloc(size); }
+static void* TestRealloc(void* p, size_t size) { GAllocCount++; return realloc(p, size); }
+
+#define STR_MEMALLOC    TestAlloc
+#define STR_MEMFREE     free
+#define STR_MEMREALLOC  TestRealloc
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+
+// Upper bound for the number of allocations needed to grow from nothing to 'len' characters with 1.5x growth
+static int MaxAllocsForLength(int len)
+{
+    int allocs = 1;
+    for (long long cap = 1; cap < len; cap = STR_GROW_CAPACITY(cap) > cap ? STR_GROW_CAPACITY(cap) : cap + 1)
+        allocs++;
+    return allocs;
+}
+
+static void TestAppend(int count)
+{
+    // append(const char*)
+    {
+        Str s;
+        GAllocCount = 0;
+        for (int n = 0; n < count; n++)
+            s.append("abcd");
+        CHECK(s.length() == count * 4);
+        CHECK(GAllocCount <= MaxAllocsForLength(count * 4));
+    }
+
+    // append(char)
+    {
+        Str s;
+        GAllocCount = 0;
+        for (int n = 0; n < count; n++)
+            s.append('x');
+        CHECK(s.length() == count);
+        CHECK(GAllocCount <= MaxAllocsForLength(count));
+    }
+
+    // appendf(), append_int()
+    {
+        Str s;
+        GAllocCount = 0;
+        for (int n = 0; n < count; n++)
+            s.appendf("%d,", n % 10);
+        CHECK(s.length() == count * 2);
+        CHECK(GAllocCount <= MaxAllocsForLength(count * 2));
+
+        Str t;
+        GAllocCount = 0;
+        for (int n = 0; n < count; n++)
+            t.append_int(n % 10);
+        CHECK(t.length() == count);
+        CHECK(GAllocCount <= MaxAllocsForLength(count));
+    }
+
+    // Spilling out of a local buffer
+    {
+        Str64 s;
+        GAllocCount = 0;
+        for (int n = 0; n < count; n++)
+            s.append("abcd");
+        CHECK(s.length() == count * 4);
+        CHECK(GAllocCount <= MaxAllocsForLength(count * 4));
+    }
+}
+
+int main()
+{
+    // O(log N): 1M appends of 1 character need about 35 allocations, not 1M
+    for (int count = 10; count <= 100000; count *= 10)
+        TestAppend(count);
+    CHECK(MaxAllocsForLength(1000000) < 40);
+
+    // reserve_exact() keeps tight sizing, reserve() grows geometrically
+    Str s;
+    s.reserve_exact(100);
+    CHECK(s.capacity() == 100);
+    s.reserve_exact(101);
+    CHECK(s.capacity() == 101);
+    s.reserve(102);
+    CHECK(s.capacity() == 151);
+    s.reserve(10);
+    CHECK(s.capacity() == 151);
+
+#if !STR_WIDE_HEADER
+    // Growth is clamped to the capacity limit (not tested with STR_WIDE_HEADER, which would allocate 2 GB)
+    Str h;
+    h.reserve(STR_CAPACITY_MAX - 10);
+    h.reserve(STR_CAPACITY_MAX - 9);
+    CHECK(h.capacity() == STR_CAPACITY_MAX);
+#endif
+
+    // clear() of a local buffer type restores the local buffer capacity
+    Str512 l("hello");
+    l.clear();
+    CHECK(l.capacity() == 511);
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
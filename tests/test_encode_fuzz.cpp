@@ -0,0 +1,204 @@
+// Test: append_json_escaped(), append_url_encoded(), append_hex(), append_base64() match reference encoders on random input, and their decoders round-trip.
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+
+static unsigned int GSeed = 7;
+static unsigned int Rand() { GSeed = GSeed * 1103515245u + 12345u; return GSeed >> 8; }
+
+static std::string RefJsonEscaped(const std::string& s)
+{
+    std::string out;
+    char buf[8];
+    for (unsigned char c : s)
+    {
+        if (c == '"')       out += "\\\"";
+        else if (c == '\\') out += "\\\\";
+        else if (c == '\b') out += "\\b";
+        else if (c == '\f') out += "\\f";
+        else if (c == '\n') out += "\\n";
+        else if (c == '\r') out += "\\r";
+        else if (c == '\t') out += "\\t";
+        else if (c < 0x20)  { snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else                out += (char)c;
+    }
+    return out;
+}
+
+static std::string RefUrlEncoded(const std::string& s)
+{
+    std::string out;
+    char buf[8];
+    for (unsigned char c : s)
+    {
+        if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
+            out += (char)c;
+        else
+            { snprintf(buf, sizeof(buf), "%%%02X", c); out += buf; }
+    }
+    return out;
+}
+
+static std::string RefHex(const std::string& s)
+{
+    std::string out;
+    char buf[4];
+    for (unsigned char c : s)
+        { snprintf(buf, sizeof(buf), "%02x", c); out += buf; }
+    return out;
+}
+
+static std::string RefBase64(const std::string& s)
+{
+    static const char* table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    size_t i = 0;
+    for (; i + 2 < s.size(); i += 3)
+    {
+        unsigned int v = ((unsigned char)s[i] << 16) | ((unsigned char)s[i + 1] << 8) | (unsigned char)s[i + 2];
+        out += table[v >> 18]; out += table[(v >> 12) & 63]; out += table[(v >> 6) & 63]; out += table[v & 63];
+    }
+    if (s.size() - i == 1)
+    {
+        unsigned int v = (unsigned char)s[i] << 16;
+        out += table[v >> 18]; out += table[(v >> 12) & 63]; out += "==";
+    }
+    else if (s.size() - i == 2)
+    {
+        unsigned int v = ((unsigned char)s[i] << 16) | ((unsigned char)s[i + 1] << 8);
+        out += table[v >> 18]; out += table[(v >> 12) & 63]; out += table[(v >> 6) & 63]; out += '=';
+    }
+    return out;
+}
+
+// Random bytes, a mix of characters needing escaping, or plain letters. Mostly short, sometimes long enough for the SSE2 scans.
+static std::string RandomInput()
+{
+    int len = (Rand() % 8 == 0) ? (int)(Rand() % 2000) : (int)(Rand() % 70);
+    int mode = Rand() % 3;
+    std::string s;
+    for (int n = 0; n < len; n++)
+        s += (mode == 0) ? (char)(Rand() & 0xFF) : (mode == 1) ? "abcXYZ019-._~\"\\/\n\t %+"[Rand() % 22] : (char)('a' + Rand() % 26);
+    return s;
+}
+
+static std::string Slice(const Str& s, int from, int len) { return std::string(s.c_str() + from, (size_t)len); }
+
+int main()
+{
+    for (int iter = 0; iter < 20000 && GFailures == 0; iter++)
+    {
+        std::string in = RandomInput();
+        StrView v(in.data(), in.data() + in.size());
+        Str16 prefix("pre:");
+        Str s, d;
+        int n, m;
+
+        s = prefix;
+        n = s.append_json_escaped(v);
+        CHECK(Slice(s, 4, n) == RefJsonEscaped(in) && s.length() == 4 + n);
+        m = d.append_json_unescaped(StrView(s.c_str() + 4, s.c_str() + 4 + n));
+        CHECK(m == (int)in.size() && Slice(d, 0, m) == in);
+
+        s = prefix;
+        n = s.append_url_encoded(v);
+        CHECK(Slice(s, 4, n) == RefUrlEncoded(in) && s.length() == 4 + n);
+        d.clear();
+        m = d.append_url_decoded(StrView(s.c_str() + 4, s.c_str() + 4 + n));
+        CHECK(m == (int)in.size() && Slice(d, 0, m) == in);
+
+        s = prefix;
+        n = s.append_hex(in.data(), (int)in.size());
+        CHECK(Slice(s, 4, n) == RefHex(in) && s.length() == 4 + n);
+        d.clear();
+        m = d.append_hex_decoded(StrView(s.c_str() + 4, s.c_str() + 4 + n));
+        CHECK(m == (int)in.size() && Slice(d, 0, m) == in);
+
+        s = prefix;
+        n = s.append_base64(in.data(), (int)in.size());
+        CHECK(Slice(s, 4, n) == RefBase64(in) && s.length() == 4 + n);
+        d.clear();
+        m = d.append_base64_decoded(StrView(s.c_str() + 4, s.c_str() + 4 + n));
+        CHECK(m == (int)in.size() && Slice(d, 0, m) == in);
+
+        // Unpadded base64 and uppercase hex decode too
+        std::string b64 = RefBase64(in);
+        while (!b64.empty() && b64[b64.size() - 1] == '=')
+            b64.erase(b64.size() - 1);
+        d.clear();
+        m = d.append_base64_decoded(b64.c_str());
+        CHECK(m == (int)in.size() && Slice(d, 0, m) == in);
+        std::string hex = RefHex(in);
+        for (size_t i = 0; i < hex.size(); i++)
+            hex[i] = (char)toupper((unsigned char)hex[i]);
+        d.clear();
+        m = d.append_hex_decoded(hex.c_str());
+        CHECK(m == (int)in.size() && Slice(d, 0, m) == in);
+
+        // Decoding random input either fails and leaves the destination untouched, or succeeds
+        Str e("x");
+        int r = e.append_json_unescaped(v);
+        CHECK(r == -1 ? e == "x" : r >= 0);
+        e = "x";
+        r = e.append_url_decoded(v);
+        CHECK(r == -1 ? e == "x" : r >= 0);
+        e = "x";
+        r = e.append_base64_decoded(v);
+        CHECK(r == -1 ? e == "x" : r >= 0);
+        e = "x";
+        r = e.append_hex_decoded(v);
+        CHECK(r == -1 ? e == "x" : r >= 0);
+    }
+
+    // JSON unicode escapes, including surrogate pairs
+    Str u;
+    CHECK(u.append_json_unescaped("a\\u00e9\\u20AC\\ud83d\\ude00\\/") == 1 + 2 + 3 + 4 + 1);
+    CHECK(u == "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80/");
+    u.clear();
+    CHECK(u.append_json_unescaped("\\ud83d") == -1 && u.length() == 0);
+    CHECK(u.append_json_unescaped("\\ude00") == -1);
+    CHECK(u.append_json_unescaped("\\x") == -1);
+    CHECK(u.append_json_unescaped("\\") == -1);
+    CHECK(u.append_json_unescaped("\\u12") == -1);
+    CHECK(u.append_url_decoded("%4") == -1);
+    CHECK(u.append_url_decoded("%zz") == -1);
+    CHECK(u.append_url_decoded("a+b%20c") == 5 && u == "a+b c");
+    u.clear();
+    CHECK(u.append_hex_decoded("abc") == -1);
+    CHECK(u.append_base64_decoded("QQ=") == -1);
+    CHECK(u.append_base64_decoded("Q") == -1);
+    CHECK(u.append_base64_decoded("QQ==") == 1 && u == "A");
+
+    // Source aliasing the destination
+    Str a("say \"hi\"");
+    a.append_json_escaped(a);
+    CHECK(a == "say \"hi\"say \\\"hi\\\"");
+    Str h("ab");
+    h.append_hex(h.c_str(), 2);
+    CHECK(h == "ab6162");
+    Str16 local("aGk=");
+    local.append_base64_decoded(local);
+    CHECK(local == "aGk=hi");
+
+    // _from() variants, non-owned destination
+    Str f("hello world");
+    f.append_url_encoded_from(5, " a/b");
+    CHECK(f == "hello%20a%2Fb");
+    Str ref;
+    ref.set_ref("lit:");
+    ref.append_base64("hi", 2);
+    CHECK(ref == "lit:aGk=");
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Test: StrHashMap<V> behaves like std::unordered_map<std::string, V> under random insert, operator[], find, erase and clear sequences.
+// Key pools are small so erases hit long probe chains (backward shift, wrapping around the end of the slots), and maps go through many rehashes.
+// Keys are on both sides of STR_HASHMAP_INLINE_KEY_SIZE and may contain zeros. Values are std::string so leaks and double destructions show under ASan.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define STR_ENABLE_HASH_MAP 1
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+
+typedef StrHashMap<std::string> Map;
+typedef std::unordered_map<std::string, std::string> RefMap;
+
+static std::vector<std::string> MakeKeys(std::mt19937& rng, int count)
+{
+    std::vector<std::string> keys;
+    keys.push_back("");
+    keys.push_back(std::string(STR_HASHMAP_INLINE_KEY_SIZE - 1, 'k'));
+    keys.push_back(std::string(STR_HASHMAP_INLINE_KEY_SIZE, 'k'));
+    keys.push_back(std::string("zero\0inside", 11));
+    while ((int)keys.size() < count)
+    {
+        std::string key;
+        int len = (int)(rng() % 4 == 0 ? rng() % 64 : rng() % (STR_HASHMAP_INLINE_KEY_SIZE + 2));
+        for (int n = 0; n < len; n++)
+            key += (char)(rng() % 16 == 0 ? 0 : 'a' + rng() % 26);
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+// Compare everything: size, iteration, lookups of every reference key
+static void CheckSame(Map& map, const RefMap& ref)
+{
+    CHECK(map.size() == (int)ref.size() && map.empty() == ref.empty());
+
+    int iterated = 0;
+    size_t long_key_bytes = 0;
+    bool ok = true;
+    for (Map::Slot& slot : map)
+    {
+        std::string key(slot.key(), (size_t)slot.KeyLen);
+        RefMap::const_iterator it = ref.find(key);
+        ok &= it != ref.end() && it->second == slot.Value && slot.key()[slot.KeyLen] == 0;
+        ok &= slot.key_view().length() == slot.KeyLen;
+        if (slot.KeyLen >= STR_HASHMAP_INLINE_KEY_SIZE)
+            long_key_bytes += (size_t)slot.KeyLen + 1;
+        iterated++;
+    }
+    CHECK(ok && iterated == (int)ref.size());
+
+    const Map& cmap = map;
+    for (const auto& kv : ref)
+    {
+        const std::string* v = cmap.find(kv.first.data(), kv.first.data() + kv.first.size());
+        ok &= v != NULL && *v == kv.second;
+    }
+    CHECK(ok);
+
+    // Slots are a power of two, long keys are counted
+    size_t slot_bytes = map.memory_usage() - long_key_bytes;
+    size_t slots = slot_bytes / sizeof(Map::Slot);
+    CHECK(slot_bytes % sizeof(Map::Slot) == 0 && (slots & (slots - 1)) == 0);
+}
+
+static void RunRandom(std::mt19937& rng, int key_count, int ops)
+{
+    std::vector<std::string> keys = MakeKeys(rng, key_count);
+    Map map;
+    RefMap ref;
+    for (int op = 0; op < ops; op++)
+    {
+        const std::string& key = keys[rng() % keys.size()];
+        StrView view(key.data(), key.data() + key.size());
+        std::string value = "value " + std::to_string(op);
+        switch (rng() % 8)
+        {
+        case 0:
+        case 1:
+        {
+            bool inserted = map.insert(view, value);
+            CHECK(inserted == ref.insert(RefMap::value_type(key, value)).second);
+            break;
+        }
+        case 2:
+            map[view] = value;
+            ref[key] = value;
+            break;
+        case 3:
+        case 4:
+        case 5:
+            CHECK(map.erase(view) == (ref.erase(key) == 1));
+            break;
+        case 6:
+        {
+            std::string* v = map.find(view);
+            RefMap::iterator it = ref.find(key);
+            CHECK((v == NULL) == (it == ref.end()) && (v == NULL || *v == it->second));
+            CHECK(map.contains(view) == (v != NULL));
+            break;
+        }
+        case 7:
+            if (rng() % 512 == 0)
+            {
+                map.clear();
+                ref.clear();
+            }
+            else if (rng() % 64 == 0)
+            {
+                map.reserve((int)ref.size() + (int)(rng() % 1000));
+            }
+            break;
+        }
+        if (op % 997 == 0)
+            CheckSame(map, ref);
+    }
+    CheckSame(map, ref);
+
+    // Erase everything in random order, the map must stay consistent after each erase
+    std::vector<std::string> remaining;
+    for (const auto& kv : ref)
+        remaining.push_back(kv.first);
+    std::shuffle(remaining.begin(), remaining.end(), rng);
+    for (size_t n = 0; n < remaining.size(); n++)
+    {
+        CHECK(map.erase(StrView(remaining[n].data(), remaining[n].data() + remaining[n].size())));
+        ref.erase(remaining[n]);
+        if (n % 31 == 0)
+            CheckSame(map, ref);
+    }
+    CHECK(map.empty());
+}
+
+int main()
+{
+    std::mt19937 rng(1234);
+
+    // Lookups in an empty map, zero-terminated keys
+    Map map;
+    CHECK(map.find("missing") == NULL && !map.erase("missing") && map.memory_usage() == 0);
+    map["short"] = "1";
+    map["a key longer than the inline key size"] = "2";
+    CHECK(map.find("short") && *map.find("short") == "1");
+    CHECK(map.find("a key longer than the inline key size") && *map.find("a key longer than the inline key size") == "2");
+    CHECK(!map.insert("short", "3") && *map.find("short") == "1");
+
+    // Few keys: the map stays small and dense, probe chains wrap around
+    RunRandom(rng, 12, 20000);
+    RunRandom(rng, 40, 50000);
+    // Many keys: rehashes, long keys moved between slot arrays
+    RunRandom(rng, 5000, 200000);
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
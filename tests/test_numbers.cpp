@@ -0,0 +1,109 @@
+// Test: append_int(), append_uint(), append_hex() and append_float() output match snprintf() byte for byte.
+// append_float() rounds with an integer fast path and a tolerance around .5 ties: random values, ties and special values guard it.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <random>
+
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+
+static void CheckFloat(double v, int precision)
+{
+    char ref[512];
+    snprintf(ref, sizeof(ref), "%.*f", precision, v);
+    Str16 s("x=");
+    int len = s.append_float(v, precision);
+    if (len != (int)strlen(ref) || strcmp(s.c_str() + 2, ref) != 0)
+    {
+        if (GFailures < 20)
+            printf("append_float(%.17g, %d): got \"%s\", expected \"%s\"\n", v, precision, s.c_str() + 2, ref);
+        GFailures++;
+    }
+}
+
+static void CheckInt(long long v)
+{
+    char ref[64];
+    Str s;
+    snprintf(ref, sizeof(ref), "%lld", v);
+    CHECK(s.append_int(v) == (int)strlen(ref) && s == ref);
+    s.clear();
+    snprintf(ref, sizeof(ref), "%llu", (unsigned long long)v);
+    CHECK(s.append_uint((unsigned long long)v) == (int)strlen(ref) && s == ref);
+    s.clear();
+    snprintf(ref, sizeof(ref), "%llx", (unsigned long long)v);
+    CHECK(s.append_hex((unsigned long long)v) == (int)strlen(ref) && s == ref);
+}
+
+int main()
+{
+    std::mt19937_64 rng(1234);
+
+    // Integers: limits, powers of 10 and their neighbors, random bits
+    const long long limits[] = { 0, 1, -1, 9, 10, 99, 100, LLONG_MAX, LLONG_MIN, LLONG_MIN + 1, INT_MAX, INT_MIN, UINT_MAX };
+    for (long long v : limits)
+        CheckInt(v);
+    for (long long p = 1; p <= LLONG_MAX / 10; p *= 10)
+    {
+        CheckInt(p - 1); CheckInt(p); CheckInt(p + 1);
+        CheckInt(-p - 1); CheckInt(-p); CheckInt(-p + 1);
+    }
+    for (int n = 0; n < 200000; n++)
+    {
+        unsigned long long bits = rng();
+        CheckInt((long long)(bits >> (rng() % 64)));
+    }
+
+    // Special values at every precision
+    const double specials[] = { 0.0, -0.0, INFINITY, -INFINITY, NAN, -NAN, DBL_MIN, -DBL_MIN, DBL_MAX, -DBL_MAX, DBL_EPSILON, 9007199254740992.0, 9007199254740993.0, 1e15, 1e16, 1e17, 1e22, 0.1, 0.7, 1.0 / 3.0 };
+    for (double v : specials)
+        for (int precision = 0; precision <= 17; precision++)
+            CheckFloat(v, precision);
+
+    // Exact ties: k / 2^n is a binary fraction, exactly halfway at precision n - 1 when the last digit is 5
+    for (int k = 0; k < 4096; k++)
+        for (int n = 1; n <= 12; n++)
+        {
+            double v = ldexp((double)k, -n);
+            for (int precision = 0; precision <= 12; precision++)
+            {
+                CheckFloat(v, precision);
+                CheckFloat(-v, precision);
+            }
+        }
+
+    // Near-ties: decimal literals which aren't exactly representable, and neighbors of exact ties
+    for (int k = 0; k < 100000; k++)
+    {
+        int precision = (int)(rng() % 6);
+        double v = ((double)k + 0.5) / pow(10.0, (double)precision);
+        CheckFloat(v, precision);
+        CheckFloat(nextafter(v, 0.0), precision);
+        CheckFloat(nextafter(v, INFINITY), precision);
+    }
+
+    // Random values: uniform bits (any magnitude), decimal-looking values, and values close to the 2^53 fast path limit
+    for (int n = 0; n < 300000; n++)
+    {
+        int precision = (int)(rng() % 18);
+        unsigned long long bits = rng();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (fabs(v) < 1e30 || isnan(v))
+            CheckFloat(v, precision);
+        CheckFloat((double)(long long)(rng() % 2000000000000LL - 1000000000000LL) / pow(10.0, (double)(rng() % 12)), precision);
+        CheckFloat(ldexp((double)(rng() >> 11), -(int)(rng() % 60)), precision);
+    }
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+// Test: make_shared() copy-on-write. Copies share the buffer, every mutation detaches first, sources pointing into a shared buffer stay valid.
+// Build with -DSTR_TEST_SANITIZE=address or thread to check for use-after-free and races.
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+
+static const char* GText = "hello world, this string is long enough to live on the heap";
+
+static void TestCopies()
+{
+    Str a(GText);
+    a.make_shared();
+    CHECK(a.shared() && !a.owned() && a == GText);
+
+    // Copies share the buffer, the original survives the release of every copy
+    {
+        Str b(a);
+        Str c;
+        c = a;
+        Str64 d(a);
+        CHECK(b.c_str() == a.c_str() && c.c_str() == a.c_str() && d.c_str() == a.c_str());
+    }
+    CHECK(a == GText);
+
+    // Copies outlive the original
+    Str* p = new Str(a);
+    a.clear();
+    CHECK(*p == GText && p->shared());
+    a = *p;
+    delete p;
+    CHECK(a == GText && a.shared());
+
+    // Moving out of a shared buffer steals the reference
+    Str m(a);
+    const char* data = m.c_str();
+    Str n(static_cast<Str&&>(m));
+    CHECK(n.c_str() == data && n.shared() && m.empty());
+    Str o;
+    o = static_cast<Str&&>(n);
+    CHECK(o.c_str() == data && n.empty());
+}
+
+static void TestDetach()
+{
+    Str a(GText);
+    a.make_shared();
+
+    // Each kind of mutation makes a private copy and leaves the other holders untouched
+    Str b(a);
+    b[0] = 'H';
+    CHECK(b.owned() && b[0] == 'H' && a == GText);
+
+    Str c(a);
+    c.append("!");
+    CHECK(c.owned() && c.length() == (int)strlen(GText) + 1 && a == GText);
+
+    Str d(a);
+    d.reserve(d.length());
+    CHECK(d.owned() && d == GText && d.c_str() != a.c_str());
+    d.c_str()[0] = 'X';
+    CHECK(a == GText);
+
+    Str e(a);
+    e.to_upper();
+    CHECK(e.owned() && e[0] == 'H' && a == GText);
+
+    Str f(a);
+    f.setf("%d", 42);
+    CHECK(f == "42" && a == GText);
+
+    Str g(a);
+    g.set("other");
+    CHECK(g == "other" && a == GText);
+
+    Str256 h(a);
+    h.setf_nogrow("%s", "nogrow");
+    CHECK(h == "nogrow" && a == GText);
+
+    // Reading through a const reference doesn't detach
+    Str i(a);
+    const Str& ci = i;
+    CHECK(ci[0] == 'h' && i.shared() && i.c_str() == a.c_str());
+}
+
+// The string is the only holder of its shared buffer, and the source of the operation points into it
+static void TestSelfSource()
+{
+    Str s(GText);
+    s.make_shared();
+    s.set(s.c_str() + 6);
+    CHECK(s == GText + 6 && s.owned());
+
+    s = GText;
+    s.make_shared();
+    s.set(s.c_str() + 6, s.c_str() + 11);
+    CHECK(s == "world");
+
+    s = GText;
+    s.make_shared();
+    StrRef ref(s.c_str() + 6);
+    s.set(ref);
+    CHECK(s == GText + 6);
+
+    s = GText;
+    s.make_shared();
+    s.append(s.c_str(), s.c_str() + 5);
+    CHECK(s.length() == (int)strlen(GText) + 5 && strcmp(s.c_str() + strlen(GText), "hello") == 0);
+
+    s = GText;
+    s.make_shared();
+    s.setf("[%s]", s.c_str() + 6);
+    CHECK(s.length() == (int)strlen(GText) - 6 + 2 && s[0] == '[' && strncmp(s.c_str() + 1, "world", 5) == 0);
+
+    s = GText;
+    s.make_shared();
+    s.appendf("%.5s", s.c_str());
+    CHECK(s.length() == (int)strlen(GText) + 5);
+
+    Str256 l(GText);
+    l.make_shared();
+    l.setf_nogrow("%.5s", l.c_str() + 6);
+    CHECK(l == "world");
+
+    s = GText;
+    s.make_shared();
+    s.fmt_set("{}{}", StrView(s.c_str(), s.c_str() + 5), s);
+    CHECK(s.length() == 5 + (int)strlen(GText) && strncmp(s.c_str(), "hellohello", 10) == 0);
+
+    s = GText;
+    s.make_shared();
+    s.concat(s, "!");
+    CHECK(s.length() == 2 * (int)strlen(GText) + 1);
+
+    // Heap buffer reallocated while appending from itself
+    Str h(GText);
+    for (int n = 0; n < 8; n++)
+        h.append(h.c_str());
+    CHECK(h.length() == (int)strlen(GText) << 8);
+}
+
+// Threads copy and release the same shared buffer concurrently, the last one to go frees it
+static void TestThreads()
+{
+    Str shared(GText);
+    shared.make_shared();
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.push_back(std::thread([&shared, &errors, t]()
+        {
+            for (int n = 0; n < 20000; n++)
+            {
+                Str copy(shared);
+                Str copy2 = copy;
+                if ((n + t) % 64 == 0)
+                    copy2.append("x"); // Detach
+                if (copy.c_str()[0] != 'h' || copy2.c_str()[0] != 'h')
+                    errors++;
+            }
+        }));
+    for (std::thread& thread : threads)
+        thread.join();
+    CHECK(errors == 0 && shared == GText);
+
+    // The original holder goes away first
+    Str* original = new Str(GText);
+    original->make_shared();
+    std::vector<Str> copies(4, *original);
+    delete original;
+    threads.clear();
+    for (int t = 0; t < 4; t++)
+        threads.push_back(std::thread([&copies, t]() { copies[t].clear(); }));
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+int main()
+{
+    TestCopies();
+    TestDetach();
+    TestSelfSource();
+    TestThreads();
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Test: the SSE2 paths of StrToLower(), StrToUpper(), StrEqualsIgnoreCase(), StrIsValidUtf8(), StrUtf8Length() and of Str::find()/rfind() match scalar references on random input.
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+
+// Reference: decode code points, rejecting overlong forms, surrogates and values past U+10FFFF
+static bool RefIsValidUtf8(const unsigned char* p, size_t n)
+{
+    size_t i = 0;
+    while (i < n)
+    {
+        unsigned int c = p[i];
+        int len;
+        unsigned int cp;
+        if (c < 0x80)                   { i++; continue; }
+        else if ((c & 0xE0) == 0xC0)    { len = 2; cp = c & 0x1F; }
+        else if ((c & 0xF0) == 0xE0)    { len = 3; cp = c & 0x0F; }
+        else if ((c & 0xF8) == 0xF0)    { len = 4; cp = c & 0x07; }
+        else return false;
+        if (i + len > n)
+            return false;
+        for (int k = 1; k < len; k++)
+        {
+            if ((p[i + k] & 0xC0) != 0x80)
+                return false;
+            cp = (cp << 6) | (p[i + k] & 0x3F);
+        }
+        if ((len == 2 && cp < 0x80) || (len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            return false;
+        i += len;
+    }
+    return true;
+}
+
+// Reference: count bytes that are not continuation bytes
+static int RefUtf8Length(const unsigned char* p, size_t n)
+{
+    int count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += (p[i] & 0xC0) != 0x80;
+    return count;
+}
+
+// Reference: ASCII-only case-insensitive compare
+static bool RefEqualsIgnoreCase(const char* a, const char* b, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x ^= 32;
+        if (y >= 'A' && y <= 'Z') y ^= 32;
+        if (x != y)
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const char* valid[] = { "h\xC3\xA9llo w\xC3\xB6rld", "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E", "emoji \xF0\x9F\x98\x80 ok", "\xF4\x8F\xBF\xBF", "\xED\x9F\xBF" };
+    for (const char* sample : valid)
+        CHECK(Str(sample).is_valid_utf8());
+    const char* invalid[] = { "\xC0\x80", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xE0\x80\x80", "\xF0\x80\x80\x80", "ab\xC3", "\x80", "\xFF", "\xF5\x80\x80\x80" };
+    for (const char* sample : invalid)
+        CHECK(!Str(sample).is_valid_utf8());
+
+    // Lengths up to 80 cover the 16-byte blocks and the scalar tails
+    std::mt19937 rng(123);
+    std::vector<unsigned char> buf;
+    for (int iter = 0; iter < 200000 && GFailures == 0; iter++)
+    {
+        size_t n = rng() % 80;
+        buf.resize(n + 1);
+        int mode = rng() % 4;
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned int r = rng();
+            if (mode == 0)
+                buf[i] = (unsigned char)(r & 0xFF);
+            else if (mode == 1)
+                buf[i] = (unsigned char)(0x20 + r % 95);
+            else
+                buf[i] = (unsigned char)((r % 8 == 0) ? 0x80 + (r >> 8) % 0x78 : 0x20 + r % 95);
+        }
+        if (mode == 3 && n >= 4)
+        {
+            // Splice a valid multi-byte sequence
+            const char* v = valid[rng() % 3];
+            size_t at = rng() % n;
+            for (size_t k = 0; v[k] && at + k < n; k++)
+                buf[at + k] = (unsigned char)v[k];
+        }
+        buf[n] = 0;
+
+        const char* b = (const char*)buf.data();
+        CHECK(StrIsValidUtf8(b, b + n) == RefIsValidUtf8(buf.data(), n));
+        CHECK(StrUtf8Length(b, b + n) == RefUtf8Length(buf.data(), n));
+
+        std::vector<char> lo(b, b + n + 1), up(b, b + n + 1);
+        StrToLower(lo.data(), lo.data() + n);
+        StrToUpper(up.data(), up.data() + n);
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned char c = buf[i];
+            CHECK((unsigned char)lo[i] == ((c >= 'A' && c <= 'Z') ? c + 32 : c));
+            CHECK((unsigned char)up[i] == ((c >= 'a' && c <= 'z') ? c - 32 : c));
+        }
+        CHECK(StrEqualsIgnoreCase(lo.data(), up.data(), (int)n));
+        if (n > 0)
+        {
+            size_t k = rng() % n;
+            up[k] = (char)(up[k] == 'x' ? 'y' : 'x');
+            CHECK(StrEqualsIgnoreCase(lo.data(), up.data(), (int)n) == RefEqualsIgnoreCase(lo.data(), up.data(), n));
+        }
+    }
+
+    // find() and rfind(): small alphabets give many first/last byte candidates, needles are often taken from the haystack
+    std::string hay;
+    std::string needle;
+    for (int iter = 0; iter < 100000 && GFailures == 0; iter++)
+    {
+        size_t n = rng() % 100;
+        char alphabet = (char)(1 + rng() % 4);
+        hay.resize(n);
+        for (size_t i = 0; i < n; i++)
+            hay[i] = (char)('a' + rng() % (unsigned int)alphabet);
+        size_t needle_len = 1 + rng() % 6;
+        if (n > 0 && rng() % 2 == 0)
+            needle = hay.substr(rng() % n, needle_len);
+        else
+            needle.assign(needle_len, (char)('a' + rng() % (unsigned int)alphabet));
+
+        Str s(hay.c_str());
+        size_t ref_rfind = hay.rfind(needle);
+        size_t ref_find = hay.find(needle);
+        CHECK(s.rfind(needle.c_str()) == (ref_rfind == std::string::npos ? -1 : (int)ref_rfind));
+        CHECK(s.find(needle.c_str()) == (ref_find == std::string::npos ? -1 : (int)ref_find));
+        size_t ref_rfind_c = hay.rfind(needle[0]);
+        CHECK(s.rfind(needle[0]) == (ref_rfind_c == std::string::npos ? -1 : (int)ref_rfind_c));
+    }
+    CHECK(Str("abc").rfind("") == 3 && Str("").rfind('a') == -1 && Str("").rfind("a") == -1);
+
+    // StrUtf8Length() flushes its per-byte counters every 255 blocks
+    std::string long_str;
+    for (int n = 0; n < 10000; n++)
+        long_str += "a\xC3\xA9";
+    CHECK(StrUtf8Length(long_str.data(), long_str.data() + long_str.size()) == 20000);
+    CHECK(StrIsValidUtf8(long_str.data(), long_str.data() + long_str.size()));
+
+    // Str wrappers: non-ASCII bytes are left alone, references and shared buffers are copied before writing
+    Str s = "Hello World 123 \xC3\x80\xC3\x89";
+    s.to_upper();
+    CHECK(s == "HELLO WORLD 123 \xC3\x80\xC3\x89");
+    s.to_lower();
+    CHECK(s == "hello world 123 \xC3\x80\xC3\x89");
+    Str r;
+    r.set_ref("Literal Ref");
+    r.to_lower();
+    CHECK(r == "literal ref" && r.owned());
+    Str sh = "Shared";
+    sh.make_shared();
+    Str sh2 = sh;
+    sh2.to_upper();
+    CHECK(sh == "Shared" && sh2 == "SHARED");
+    CHECK(Str("Content-Type").equals_ignore_case("content-type"));
+    CHECK(!Str("abc").equals_ignore_case("abcd"));
+    CHECK(!Str("a[").equals_ignore_case("a{"));
+    CHECK(Str("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E").utf8_length() == 3);
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
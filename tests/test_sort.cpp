@@ -0,0 +1,175 @@
+// Test: StrSort() on arrays of Str, StrRef and StrView gives the same order as std::sort() with strcmp() (memcmp() then length for StrView).
+// Inputs favor the radix sort corner cases: long shared prefixes (keys are 8 bytes), bytes >= 0x80, strings which are prefixes of each other, embedded zeros.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+
+enum Family
+{
+    Family_Short,           // Few letters, many duplicates
+    Family_SharedPrefix8,   // Same first 8 bytes
+    Family_SharedPrefix16,  // Same first 16 bytes, differences right after the second key
+    Family_HighBytes,       // Bytes >= 0x80 mixed with ASCII, strcmp() compares them as unsigned
+    Family_Prefixes,        // "a", "aa", "aaa"... and neighbors
+    Family_Zeros,           // Embedded zeros (StrView only)
+    Family_COUNT
+};
+
+static std::string MakeString(std::mt19937& rng, Family family)
+{
+    std::string s;
+    int len = (int)(rng() % 24);
+    switch (family)
+    {
+    case Family_Short:
+        len = (int)(rng() % 5);
+        for (int n = 0; n < len; n++)
+            s += (char)('a' + rng() % 3);
+        break;
+    case Family_SharedPrefix8:
+        s = "prefix__";
+        for (int n = 0; n < len; n++)
+            s += (char)('a' + rng() % 4);
+        break;
+    case Family_SharedPrefix16:
+        s = "0123456789abcdef";
+        if (rng() % 4 == 0)
+            s.resize(8 + rng() % 9);
+        for (int n = 0; n < len % 4; n++)
+            s += (char)('x' + rng() % 2);
+        break;
+    case Family_HighBytes:
+        for (int n = 0; n < len; n++)
+        {
+            static const unsigned char bytes[] = { 'a', 'b', 0x7F, 0x80, 0x81, 0xC3, 0xFE, 0xFF };
+            s += (char)bytes[rng() % sizeof(bytes)];
+        }
+        break;
+    case Family_Prefixes:
+        s.assign(rng() % 20, 'a');
+        if (rng() % 3 == 0)
+            s += (char)('a' + rng() % 3 - 1);
+        break;
+    case Family_Zeros:
+        for (int n = 0; n < len; n++)
+        {
+            static const unsigned char bytes[] = { 0, 0, 1, 'a', 0x80, 0xFF };
+            s += (char)bytes[rng() % sizeof(bytes)];
+        }
+        break;
+    default:
+        break;
+    }
+    return s;
+}
+
+static bool LessStrcmp(const char* a, const char* b)
+{
+    return strcmp(a, b) < 0;
+}
+
+static bool LessBytes(const std::string& a, const std::string& b)
+{
+    size_t len = a.size() < b.size() ? a.size() : b.size();
+    int cmp = memcmp(a.data(), b.data(), len);
+    return cmp < 0 || (cmp == 0 && a.size() < b.size());
+}
+
+// Strings without zeros: check Str and StrRef arrays against strcmp() order
+static void TestStrArrays(const std::vector<std::string>& strings)
+{
+    std::vector<const char*> expected;
+    std::vector<Str> strs;
+    std::vector<StrRef> refs;
+    strs.reserve(strings.size());
+    refs.reserve(strings.size());
+    for (size_t n = 0; n < strings.size(); n++)
+    {
+        expected.push_back(strings[n].c_str());
+        strs.push_back(Str(strings[n].c_str()));
+        if (n % 7 == 0)
+            strs.back().make_shared();
+        refs.push_back(StrRef(strings[n].c_str()));
+    }
+    std::sort(expected.begin(), expected.end(), LessStrcmp);
+    StrSort(strs.data(), strs.data() + strs.size());
+    StrSort(refs.data(), refs.data() + refs.size());
+
+    bool ok = true;
+    for (size_t n = 0; n < strings.size() && ok; n++)
+    {
+        ok &= strcmp(strs[n].c_str(), expected[n]) == 0 && strs[n].length() == (int)strlen(expected[n]);
+        ok &= strcmp(refs[n].c_str(), expected[n]) == 0 && !refs[n].owned();
+    }
+    CHECK(ok);
+}
+
+// Any bytes: check StrView arrays against memcmp() then length order
+static void TestViewArray(const std::vector<std::string>& strings)
+{
+    std::vector<std::string> expected(strings);
+    std::sort(expected.begin(), expected.end(), LessBytes);
+    std::vector<StrView> views;
+    for (size_t n = 0; n < strings.size(); n++)
+        views.push_back(StrView(strings[n].data(), strings[n].data() + strings[n].size()));
+    StrSort(views.data(), views.data() + views.size());
+
+    bool ok = true;
+    for (size_t n = 0; n < strings.size() && ok; n++)
+        ok &= views[n].length() == (int)expected[n].size() && memcmp(views[n].Begin, expected[n].data(), expected[n].size()) == 0;
+    CHECK(ok);
+}
+
+int main()
+{
+    std::mt19937 rng(1234);
+
+    // Empty and single element arrays
+    StrSort((Str*)NULL, (Str*)NULL);
+    StrSort((StrRef*)NULL, (StrRef*)NULL);
+    StrSort((StrView*)NULL, (StrView*)NULL);
+    Str one("one");
+    StrSort(&one, &one + 1);
+    CHECK(one == "one");
+
+    // Sizes on both sides of the insertion sort and radix thresholds, one family or all mixed
+    const int sizes[] = { 2, 3, 10, 16, 17, 63, 64, 65, 200, 1000, 20000 };
+    for (int size : sizes)
+        for (int family = 0; family <= Family_COUNT; family++)
+        {
+            std::vector<std::string> strings;
+            for (int n = 0; n < size; n++)
+                strings.push_back(MakeString(rng, family < Family_COUNT ? (Family)family : (Family)(rng() % Family_COUNT)));
+            TestViewArray(strings);
+            for (std::string& s : strings)
+                s.resize(strlen(s.c_str()));
+            TestStrArrays(strings);
+        }
+
+    // Already sorted, reversed, all equal
+    std::vector<std::string> strings;
+    for (int n = 0; n < 5000; n++)
+        strings.push_back(MakeString(rng, Family_SharedPrefix8));
+    std::sort(strings.begin(), strings.end(), LessBytes);
+    TestStrArrays(strings);
+    std::reverse(strings.begin(), strings.end());
+    TestStrArrays(strings);
+    strings.assign(5000, "all the same, longer than the 8 bytes of a key");
+    TestStrArrays(strings);
+    TestViewArray(strings);
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,251 @@
+// Test: length() stays equal to strlen(c_str()) after every kind of modification.
+// With STR_TRACK_LENGTH length() returns the cached Length, which every code path must keep in sync. Without it this checks the contents only.
+// Built twice by CMakeLists.txt: with the configuration under test, and with STR_TRACK_LENGTH=1.
+
+#include <stdio.h>
+#include <string.h>
+
+#define STR_IMPLEMENTATION
+#include "Str.h"
+
+static int GFailures = 0;
+#define CHECK(expr)     do { if (!(expr)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); GFailures++; } } while (0)
+#define CHECK_STR(s, expected)  do { CHECK(strcmp((s).c_str(), (expected)) == 0); CHECK((s).length() == (int)strlen(expected)); } while (0)
+
+static const char* GLong = "a string long enough to never fit in a local buffer or inline";
+
+static int SetfvHelper(Str& s, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = s.setfv(fmt, args);
+    va_end(args);
+    return len;
+}
+
+static void TestSet()
+{
+    Str s;
+    CHECK_STR(s, "");
+    s.set("hello");
+    CHECK_STR(s, "hello");
+    s.set(GLong);
+    CHECK_STR(s, GLong);
+    s.set(GLong, GLong + 8);
+    CHECK_STR(s, "a string");
+    s.set(StrView(GLong + 2, GLong + 8));
+    CHECK_STR(s, "string");
+    s.set(StrView());
+    CHECK_STR(s, "");
+    s = "assigned";
+    CHECK_STR(s, "assigned");
+
+    // From other strings: owned, shared, reference, local buffer
+    Str other(GLong);
+    s.set(other);
+    CHECK_STR(s, GLong);
+    other.make_shared();
+    CHECK_STR(other, GLong);
+    s.set("x");
+    s = other;
+    CHECK_STR(s, GLong);
+    s = StrRef("ref");
+    CHECK_STR(s, "ref");
+    Str16 local("local");
+    s = local;
+    CHECK_STR(s, "local");
+    local = GLong;
+    CHECK_STR(local, GLong);
+    local = "short";
+    CHECK_STR(local, "short");
+    s.set_ref("set_ref");
+    CHECK_STR(s, "set_ref");
+
+    // Formatted
+    s.setf("%d-%s", 42, "x");
+    CHECK_STR(s, "42-x");
+    s.setf("%s%s", GLong, GLong);
+    CHECK((int)strlen(s.c_str()) == 2 * (int)strlen(GLong) && s.length() == 2 * (int)strlen(GLong));
+    SetfvHelper(s, "%s", "va");
+    CHECK_STR(s, "va");
+    Str16 nogrow;
+    nogrow.setf_nogrow("%s", GLong);
+    CHECK(nogrow.length() == (int)strlen(nogrow.c_str()) && nogrow.length() == 15);
+    nogrow.setf_nogrow("%d", 7);
+    CHECK_STR(nogrow, "7");
+    s.fmt_set("{}:{}", "key", 12);
+    CHECK_STR(s, "key:12");
+}
+
+static void TestAppend()
+{
+    Str s;
+    s.append('a');
+    CHECK_STR(s, "a");
+    s.append("bc");
+    CHECK_STR(s, "abc");
+    s.append(GLong, GLong + 2);
+    CHECK_STR(s, "abca ");
+    s.append(StrView("view"));
+    CHECK_STR(s, "abca view");
+    s.appendf("%d", 123);
+    CHECK_STR(s, "abca view123");
+    s.append_from(3, "X");
+    CHECK_STR(s, "abcX");
+    s.append_from(1, 'Y');
+    CHECK_STR(s, "aY");
+    s.appendf_from(0, "%s", "from");
+    CHECK_STR(s, "from");
+    s.append_int(-5);
+    s.append_uint(6);
+    s.append_hex(255);
+    s.append_float(1.25, 2);
+    CHECK_STR(s, "from-56ff1.25");
+    s.append_int_from(4, 1);
+    CHECK_STR(s, "from1");
+    s.append_float_from(0, 0.5, 1);
+    CHECK_STR(s, "0.5");
+
+    // Growing from empty, local buffer and reference
+    for (int n = 0; n < 200; n++)
+        s.append("0123456789");
+    CHECK(s.length() == 2003 && (int)strlen(s.c_str()) == 2003);
+    Str16 local("abc");
+    local.append(GLong);
+    CHECK(local.length() == 3 + (int)strlen(GLong) && (int)strlen(local.c_str()) == local.length());
+    StrRef ref("ref");
+    ref.append("!");
+    CHECK_STR(ref, "ref!");
+
+    // Encoders, decoders, fmt, concat, join
+    s.clear();
+    s.append_json_escaped("a\"b\n");
+    CHECK_STR(s, "a\\\"b\\n");
+    s.append_url_encoded("a b");
+    CHECK_STR(s, "a\\\"b\\na%20b");
+    s.clear();
+    s.append_hex("\x01\xff", 2);
+    s.append_base64("abc", 3);
+    CHECK_STR(s, "01ffYWJj");
+    s.clear();
+    s.append_base64_decoded("aGVsbG8=");
+    CHECK_STR(s, "hello");
+    s.append_hex_decoded("2121");
+    CHECK_STR(s, "hello!!");
+    CHECK(s.append_hex_decoded("zz") == -1);
+    CHECK_STR(s, "hello!!");
+    s.append_url_decoded("%41");
+    s.append_json_unescaped("\\u00e9");
+    CHECK_STR(s, "hello!!A\xc3\xa9");
+    s.fmt_append("{}", 3.5);
+    CHECK_STR(s, "hello!!A\xc3\xa9" "3.500000");
+    s.concat("-", GLong);
+    CHECK((int)strlen(s.c_str()) == s.length());
+    const char* names[] = { "x", "y", "z" };
+    s.clear();
+    s.join(", ", names, names + 3);
+    CHECK_STR(s, "x, y, z");
+}
+
+static void TestBuffer()
+{
+    Str s(GLong);
+    s.clear();
+    CHECK_STR(s, "");
+    s.set(GLong);
+    s.reserve(1000);
+    CHECK_STR(s, GLong);
+    s.reserve_exact(2000);
+    CHECK_STR(s, GLong);
+    s.set("short");
+    s.shrink_to_fit();
+    CHECK_STR(s, "short");
+    Str16 local(GLong);
+    local.set("fits");
+    local.shrink_to_fit();
+    CHECK_STR(local, "fits");
+
+    s.set(GLong);
+    s.make_shared();
+    CHECK_STR(s, GLong);
+    Str copy(s);
+    copy[0] = 'A';
+    CHECK(copy.length() == (int)strlen(GLong) && copy[0] == 'A');
+    copy.to_upper();
+    CHECK((int)strlen(copy.c_str()) == copy.length());
+    copy.to_lower();
+    CHECK_STR(copy, GLong);
+
+    // Writes through c_str() then update_length()
+    s.set(GLong);
+    s.c_str()[8] = 0;
+    CHECK(s.update_length() == 8);
+    CHECK_STR(s, "a string");
+    s.reserve(100);
+    strcpy(s.c_str(), "rewritten, longer than before");
+    s.update_length();
+    CHECK_STR(s, "rewritten, longer than before");
+    s.c_str()[0] = 0;
+    s.update_length();
+    CHECK_STR(s, "");
+}
+
+static void TestMove()
+{
+    // Heap buffer is stolen
+    Str heap(GLong);
+    const char* data = heap.c_str();
+    Str stolen(static_cast<Str&&>(heap));
+    CHECK(stolen.c_str() == data);
+    CHECK_STR(stolen, GLong);
+    CHECK_STR(heap, "");
+    Str assigned;
+    assigned = static_cast<Str&&>(stolen);
+    CHECK_STR(assigned, GLong);
+    CHECK_STR(stolen, "");
+
+    // Local buffer is copied, into a heap string, an empty string and another local buffer
+    Str30 local("local contents");
+    Str dst(GLong);
+    dst = static_cast<Str&&>(local);
+    CHECK_STR(dst, "local contents");
+    Str30 local2("other local");
+    Str empty(static_cast<Str&&>(local2));
+    CHECK_STR(empty, "other local");
+    Str30 local3("third");
+    Str30 local4(static_cast<Str30&&>(local3));
+    CHECK_STR(local4, "third");
+    Str16 small;
+    small = static_cast<Str&&>(assigned);
+    CHECK_STR(small, GLong);
+
+    // Reference: the pointer is copied
+    StrRef ref("referenced");
+    Str from_ref(static_cast<Str&&>(ref));
+    CHECK_STR(from_ref, "referenced");
+    Str30 local_from_ref("x");
+    local_from_ref = static_cast<Str&&>(StrRef("referenced too"));
+    CHECK_STR(local_from_ref, "referenced too");
+
+    // Shared reference is stolen
+    Str shared(GLong);
+    shared.make_shared();
+    Str keep(shared);
+    Str from_shared(static_cast<Str&&>(shared));
+    CHECK_STR(from_shared, GLong);
+    CHECK_STR(shared, "");
+    CHECK_STR(keep, GLong);
+}
+
+int main()
+{
+    TestSet();
+    TestAppend();
+    TestBuffer();
+    TestMove();
+
+    if (GFailures > 0)
+        return 1;
+    printf("OK\n");
+    return 0;
+}